@@ -48,6 +48,7 @@ int main(int argc, char *argv[])
     int i = 0; 
     int number_of_processes = 1, number_of_objects = 1024, max_size_of_objects = 8192, number_of_containers = 1;
     int a, j, cid, size, stat, child_pid, devfd, max_size_of_objects_with_buffer;
+    int use_arena = 0;
     char filename[256];
     char *mapped_data, *data;
     unsigned long long msec_time;
@@ -58,7 +59,7 @@ int main(int argc, char *argv[])
     // takes arguments from command line interface.
     if (argc < 4)
     {
-        fprintf(stderr, "Usage: %s number_of_objects max_size_of_objects number_of_processes number_of_containers\n", argv[0]);
+        fprintf(stderr, "Usage: %s number_of_objects max_size_of_objects number_of_processes number_of_containers [arena]\n", argv[0]);
         exit(1);
     }
 
@@ -66,6 +67,10 @@ int main(int argc, char *argv[])
     max_size_of_objects = atoi(argv[2]);
     number_of_processes = atoi(argv[3]);
     number_of_containers = atoi(argv[4]);
+    if (argc > 5 && strcmp(argv[5], "arena") == 0)
+    {
+        use_arena = 1;
+    }
 
     max_size_of_objects_with_buffer = max_size_of_objects + 100;
     pid = (pid_t *) calloc(number_of_processes - 1, sizeof(pid_t));
@@ -103,11 +108,25 @@ int main(int argc, char *argv[])
     cid = getpid() % number_of_containers;
     mcontainer_create(devfd, cid);
 
+    // in arena mode map every object of the container with a single mmap.
+    if (use_arena)
+    {
+        if (!mcontainer_arena(devfd, number_of_objects, max_size_of_objects))
+        {
+            fprintf(stderr, "Failed in mcontainer_arena()\n");
+            exit(1);
+        }
+        mcontainer_arena_prefault(devfd, 0, number_of_objects);
+    }
+
     // Writing to objects
     for (i = 0; i < number_of_objects; i++)
     {
         mcontainer_lock(devfd, i);
-        mapped_data = (char *)mcontainer_alloc(devfd, i, max_size_of_objects);
+        if (use_arena)
+            mapped_data = (char *)mcontainer_arena_object(i);
+        else
+            mapped_data = (char *)mcontainer_alloc(devfd, i, max_size_of_objects);
 
         // error handling
         if (!mapped_data)
@@ -0,0 +1,195 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+//
+//
+//                             Copyright 2016
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Author:  Hung-Wei Tseng, Yu-Chia Liu
+//
+//   Description:
+//     Ring vs. Lock/Unlock Message Passing Benchmark of Memory Container
+//
+////////////////////////////////////////////////////////////////////////
+
+#include <mcontainer.h>
+#include <mcring.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/wait.h>
+
+#define RING_OBJECT 0
+#define MAILBOX_OBJECT 1
+#define OBJECT_SIZE 65536
+
+struct message
+{
+    __u64 seq;
+    __u64 sent_ns;
+};
+
+struct mailbox
+{
+    __u64 full;
+    struct message msg;
+};
+
+static __u64 now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * Send one message through a mailbox object guarded by the container lock,
+ * which is what applications had to do before rings: lock, write, unlock.
+ */
+static void mailbox_send(int devfd, struct mailbox *box, struct message *msg)
+{
+    int sent = 0;
+    while (!sent)
+    {
+        mcontainer_lock(devfd, MAILBOX_OBJECT);
+        if (!box->full)
+        {
+            box->msg = *msg;
+            box->full = 1;
+            sent = 1;
+        }
+        mcontainer_unlock(devfd, MAILBOX_OBJECT);
+    }
+}
+
+static void mailbox_receive(int devfd, struct mailbox *box, struct message *msg)
+{
+    int received = 0;
+    while (!received)
+    {
+        mcontainer_lock(devfd, MAILBOX_OBJECT);
+        if (box->full)
+        {
+            *msg = box->msg;
+            box->full = 0;
+            received = 1;
+        }
+        mcontainer_unlock(devfd, MAILBOX_OBJECT);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int devfd, child_pid, stat, use_lock, flags = MCRING_SPSC;
+    long i, number_of_messages;
+    __u64 start, latency, total_latency = 0, max_latency = 0;
+    struct mcring ring;
+    struct mailbox *box;
+    struct message msg;
+    void *object;
+
+    if (argc < 3)
+    {
+        fprintf(stderr, "Usage: %s number_of_messages spsc|mpmc|lock\n", argv[0]);
+        exit(1);
+    }
+    number_of_messages = atol(argv[1]);
+    use_lock = strcmp(argv[2], "lock") == 0;
+    if (strcmp(argv[2], "mpmc") == 0)
+        flags = MCRING_MPMC;
+
+    devfd = open("/dev/mcontainer", O_RDWR);
+    if (devfd < 0)
+    {
+        fprintf(stderr, "Device open failed");
+        exit(1);
+    }
+
+    // the parent produces and the child consumes, both in the same container.
+    child_pid = fork();
+    mcontainer_create(devfd, 0);
+
+    if (use_lock)
+    {
+        box = (struct mailbox *)mcontainer_alloc(devfd, MAILBOX_OBJECT, OBJECT_SIZE);
+        if (box == MAP_FAILED)
+        {
+            fprintf(stderr, "Failed in mcontainer_alloc()\n");
+            exit(1);
+        }
+    }
+    else
+    {
+        object = mcontainer_alloc(devfd, RING_OBJECT, OBJECT_SIZE);
+        if (object == MAP_FAILED || mcring_open(&ring, devfd, RING_OBJECT, object, OBJECT_SIZE, sizeof(struct message), flags) < 0)
+        {
+            fprintf(stderr, "Failed to open the ring\n");
+            exit(1);
+        }
+    }
+
+    start = now_ns();
+    for (i = 0; i < number_of_messages; i++)
+    {
+        if (child_pid != 0)
+        {
+            msg.seq = i;
+            msg.sent_ns = now_ns();
+            if (use_lock)
+                mailbox_send(devfd, box, &msg);
+            else
+                mcring_push(&ring, &msg);
+        }
+        else
+        {
+            if (use_lock)
+                mailbox_receive(devfd, box, &msg);
+            else
+                mcring_pop(&ring, &msg);
+            latency = now_ns() - msg.sent_ns;
+            total_latency += latency;
+            if (latency > max_latency)
+                max_latency = latency;
+            if (msg.seq != (__u64)i)
+            {
+                fprintf(stderr, "Out of order message %llu, expected %ld\n", msg.seq, i);
+                exit(1);
+            }
+        }
+    }
+
+    if (child_pid == 0)
+    {
+        printf("%s: %ld messages, %.0f msgs/s, avg latency %llu ns, max latency %llu ns\n", argv[2], number_of_messages,
+               number_of_messages * 1e9 / (now_ns() - start), total_latency / number_of_messages, max_latency);
+    }
+    else
+    {
+        waitpid(child_pid, &stat, 0);
+    }
+
+    mcontainer_delete(devfd);
+    close(devfd);
+    return 0;
+}
@@ -39,12 +39,157 @@ struct memory_container_cmd
     __u64 op;
     __u64 cid;
     __u64 oid;
+    __u64 size;
+    __u64 addr;
 };
 
+/**
+ * Sleep in the kernel while the 32-bit word at offset inside object oid
+ * still holds value, until another member issues a wake on that word. A
+ * wake with offset MCONTAINER_WAKE_OBJECT wakes the waiters on every word
+ * of the object.
+ */
+#define MCONTAINER_WAKE_OBJECT (~0ULL)
+
+struct memory_container_wait_cmd
+{
+    __u64 oid;
+    __u64 offset;
+    __u64 value;
+};
+
+/**
+ * Per-container counters. last_miss tells whether the last object the
+ * calling task mapped had been evicted (or never existed) and was created
+ * zeroed. dedup_saved is this container's share of the bytes no longer
+ * allocated because identical objects were merged. zbytes of cold objects
+ * are held compressed in zstored bytes; inflates counts the objects
+ * decompressed on access and inflate_ns the time spent doing so.
+ */
+struct memory_container_stats
+{
+    __u64 hits;
+    __u64 misses;
+    __u64 evictions;
+    __u64 bytes;
+    __u64 budget;
+    __u64 last_miss;
+    __u64 dedup_saved;
+    __u64 zbytes;
+    __u64 zstored;
+    __u64 inflates;
+    __u64 inflate_ns;
+};
+
+/**
+ * Name an object with a string key instead of an agreed integer oid.
+ */
+#define MCONTAINER_KEY_MAX 64
+
+struct memory_container_key_cmd
+{
+    char key[MCONTAINER_KEY_MAX];
+    __u64 oid;
+    __u64 size;
+    __u64 addr;
+};
+
+/**
+ * Conditional update of an object: a compare-and-swap of the 64-bit word
+ * at offset, or a write of size bytes from buf, applied only while the
+ * object is still at version (pass MCONTAINER_ANY_VERSION to skip the
+ * check). The current version is returned in version.
+ */
+#define MCONTAINER_ANY_VERSION (~0ULL)
+#define MCONTAINER_CWRITE_MAX 4096
+
+struct memory_container_cas_cmd
+{
+    __u64 oid;
+    __u64 offset;
+    __u64 expected;
+    __u64 desired;
+    __u64 version;
+    __u64 size;
+    __u64 buf;
+};
+
+/**
+ * Share an object read-only across containers: publish freezes object oid
+ * under a global name, attach makes that memory object oid of the caller's
+ * container. size returns the object size.
+ */
+struct memory_container_publish_cmd
+{
+    __u64 oid;
+    __u64 name;
+    __u64 size;
+};
+
+/**
+ * Subscribe an open file of the device to the count oids in the array at
+ * oids. A write (a conditional update, a wake naming the oid or the end of
+ * a writable mapping) and/or an unlock, as selected by events, marks the
+ * oid changed: read() on the file returns the changed oids as __u64 and
+ * poll() reports POLLIN while there are some. An eventfd other than -1 is
+ * also signalled on every change. A count of 0 drops the subscription.
+ */
+#define MCONTAINER_WATCH_WRITE 1
+#define MCONTAINER_WATCH_UNLOCK 2
+#define MCONTAINER_WATCH_MAX 4096
+
+struct memory_container_watch_cmd
+{
+    __u64 oids;
+    __u64 count;
+    __u64 events;
+    __s64 eventfd;
+};
+
+/**
+ * Access hints given in op to MCONTAINER_IOCTL_ADVISE for objects
+ * [oid, oid + size), numbered like the madvise() ones
+ */
+#define MCONTAINER_ADV_NORMAL 0
+#define MCONTAINER_ADV_RANDOM 1
+#define MCONTAINER_ADV_SEQUENTIAL 2
+#define MCONTAINER_ADV_WILLNEED 3
+#define MCONTAINER_ADV_DONTNEED 4
+
+/**
+ * Eviction order of a container in cache mode
+ */
+#define MCONTAINER_EVICT_CLOCK 0
+#define MCONTAINER_EVICT_LRU 1
+
+/**
+ * mmap offset (in pages) of the arena window. Mapping the device at
+ * MCONTAINER_ARENA_PGOFF * page size maps the whole object space of the
+ * container; object oid lives at oid * arena object size inside it.
+ */
+#define MCONTAINER_ARENA_PGOFF (1ULL << 32)
+
 #define MCONTAINER_IOCTL_DELETE _IOWR('N', 0x45, struct memory_container_cmd)
 #define MCONTAINER_IOCTL_CREATE _IOWR('N', 0x46, struct memory_container_cmd)
 #define MCONTAINER_IOCTL_LOCK _IOWR('N', 0x47, struct memory_container_cmd)
 #define MCONTAINER_IOCTL_UNLOCK _IOWR('N', 0x48, struct memory_container_cmd)
 #define MCONTAINER_IOCTL_FREE _IOWR('N', 0x49, struct memory_container_cmd)
+#define MCONTAINER_IOCTL_ARENA _IOWR('N', 0x4a, struct memory_container_cmd)
+#define MCONTAINER_IOCTL_PREFAULT _IOWR('N', 0x4b, struct memory_container_cmd)
+#define MCONTAINER_IOCTL_WAIT _IOWR('N', 0x4c, struct memory_container_wait_cmd)
+#define MCONTAINER_IOCTL_WAKE _IOWR('N', 0x4d, struct memory_container_wait_cmd)
+#define MCONTAINER_IOCTL_CACHE _IOWR('N', 0x4e, struct memory_container_cmd)
+#define MCONTAINER_IOCTL_STATS _IOR('N', 0x4f, struct memory_container_stats)
+#define MCONTAINER_IOCTL_PUT _IOWR('N', 0x50, struct memory_container_key_cmd)
+#define MCONTAINER_IOCTL_GET _IOWR('N', 0x51, struct memory_container_key_cmd)
+#define MCONTAINER_IOCTL_DEL _IOWR('N', 0x52, struct memory_container_key_cmd)
+#define MCONTAINER_IOCTL_CAS _IOWR('N', 0x53, struct memory_container_cas_cmd)
+#define MCONTAINER_IOCTL_CWRITE _IOWR('N', 0x54, struct memory_container_cas_cmd)
+#define MCONTAINER_IOCTL_PUBLISH _IOWR('N', 0x55, struct memory_container_publish_cmd)
+#define MCONTAINER_IOCTL_ATTACH _IOWR('N', 0x56, struct memory_container_publish_cmd)
+#define MCONTAINER_IOCTL_DEDUP _IOWR('N', 0x57, struct memory_container_cmd)
+#define MCONTAINER_IOCTL_COMPRESS _IOWR('N', 0x58, struct memory_container_cmd)
+#define MCONTAINER_IOCTL_ADVISE _IOWR('N', 0x59, struct memory_container_cmd)
+#define MCONTAINER_IOCTL_WATCH _IOWR('N', 0x5a, struct memory_container_watch_cmd)
 
 #endif
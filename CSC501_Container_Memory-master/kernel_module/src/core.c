@@ -46,14 +46,18 @@
 
 extern struct miscdevice memory_container_dev;
 extern void delete_all(void);
+extern void memory_container_lock_init(void);
+extern void memory_container_lock_exit(void);
 
 int memory_container_init(void)
 {
     int ret;
 
+    memory_container_lock_init();
     if ((ret = misc_register(&memory_container_dev)))
     {
         printk(KERN_ERR "Unable to register \"memory_container\" misc device\n");
+        memory_container_lock_exit();
         return ret;
     }
 
@@ -67,6 +71,7 @@ int memory_container_init(void)
 void memory_container_exit(void)
 {
     printk("Exiting core.c");
+    memory_container_lock_exit();
     delete_all();
     misc_deregister(&memory_container_dev);
 }
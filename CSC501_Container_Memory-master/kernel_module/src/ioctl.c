@@ -43,42 +43,223 @@
 #include <linux/poll.h>
 #include <linux/mutex.h>
 #include <linux/sched.h>
+#include <linux/pagemap.h>
+#include <linux/mman.h>
+#include <linux/hashtable.h>
+#include <linux/jhash.h>
+#include <linux/workqueue.h>
+#include <linux/vmalloc.h>
+#include <linux/lz4.h>
+#include <linux/ktime.h>
+#include <linux/eventfd.h>
+#include <linux/sort.h>
+#include <linux/bsearch.h>
+#include <linux/llist.h>
+#include <linux/profile.h>
 
 
+/**
+ * Membership of a task in a container. It is also hashed by task in
+ * task_map so the container of a task can be found without the mutex;
+ * entries are freed after an RCU grace period, with the task pinned until
+ * then so its address cannot be reused by a new task meanwhile.
+ */
 typedef struct process_list
 {
-	struct task_struct *process;
+	struct task_struct *process; //pinned with get_task_struct() while listed
+	int last_miss; //whether the last object this task mapped had to be created
+	struct container_list *container;
+	struct hlist_node tnode;
+	struct rcu_head rcu;
 	struct process_list* next;
 }process_list;
 
+/**
+ * Memory behind an object. It normally belongs to a single object; once
+ * published it is frozen read-only and shared by objects of any container
+ * that attaches it, and freed when the last of them goes away. The dedup
+ * scanner also shares it between objects with identical contents; those
+ * get a private copy again before anything may write to it. Memory of a
+ * cold object may be swapped for an LZ4 compressed copy in zdata, leaving
+ * virt_addr NULL until the object is used again; with zdata NULL too the
+ * memory was released by DONTNEED and comes back zeroed.
+ */
+typedef struct object_data
+{
+	char *virt_addr;
+	unsigned long pfn;
+	unsigned long size;
+	int refs; //objects backed by this memory
+	int readonly; //published, no writable mapping may be created
+	u64 name; //name it was published under
+	struct object_data *next; //next published object
+	int hashed; //contents unchanged since hashed into dedup_table
+	u32 hash;
+	struct hlist_node dnode;
+	unsigned char *zdata;
+	size_t zsize;
+	struct llist_node reclaim; //queued for reclaim_data() once the last reference is gone
+	int pins; //dedup scanner reads it outside the mutex, it is not freed nor compressed meanwhile
+	unsigned long writes; //bumped before every write so the scanner can tell it changed
+}object_data;
+
 typedef struct object_list
 {
 	int oid;
-	unsigned long pfn;
-	char *virt_addr;
+	object_data *data;
+	int refs; //live mappings of the object, it is only evictable at 0
+	int wrefs; //live mappings that may write to the object
+	int referenced; //CLOCK reference bit
+	int freed; //unlinked from the container, memory goes with the last mapping
+	u64 version; //bumped by every successful conditional update
+	unsigned long last_used; //jiffies of the last access or unmap, for the compressor
+	int advice; //MCONTAINER_ADV_NORMAL, RANDOM or SEQUENTIAL
+	struct container_list *container; //container the object was created in
 	struct object_list *next;
 }object_list;
 
+/**
+ * Object lock. It is not a kernel mutex so that the lock of a task that
+ * exits while holding it can be handed on: the next owner gets it marked
+ * abandoned.
+ */
 typedef struct lock_list
 {
 	int oid;
-	struct mutex mutex_lock;
+	struct task_struct *owner; //NULL while the lock is free
+	int abandoned; //last owner went away holding it
+	wait_queue_head_t wq;
 	struct lock_list *next;
 }lock_list;
 
+/**
+ * Binding of a string key to an object. Readers walk the hash chains under
+ * RCU only; writers serialize on the container's keys_lock.
+ */
+typedef struct key_entry
+{
+	struct hlist_node node;
+	struct rcu_head rcu;
+	u32 hash;
+	unsigned long oid;
+	unsigned long size;
+	char key[MCONTAINER_KEY_MAX];
+}key_entry;
+
+#define KEY_HASH_BITS 8
+
+/**
+ * Subscription of an open file of the device to changes of some objects,
+ * kept in the file's private_data until it is closed. pending has a bit
+ * per entry of the sorted oids array.
+ */
+typedef struct watch_list
+{
+	struct container_list *container; //container watched, NULL if not subscribed
+	u64 *oids;
+	unsigned long count;
+	unsigned long *pending;
+	unsigned long npending;
+	int events;
+	struct eventfd_ctx *eventfd;
+	wait_queue_head_t wq; //readers and pollers of the file
+	struct watch_list *next;
+}watch_list;
+
 typedef struct container_list
 {
 	int cid;
 	object_list* olist;
 	process_list* list;
 	lock_list* llist;
+	unsigned long arena_objects; //number of objects in the arena window, 0 if no arena
+	unsigned long arena_size; //page aligned size of every arena object
+	unsigned long arena_addr; //address every member must map the arena at, 0 if anywhere
+	wait_queue_head_t wq; //members sleeping in memory_container_wait()
+	unsigned long cache_budget; //bytes of objects kept before evicting, 0 if not a cache
+	unsigned long cache_bytes; //bytes of objects currently allocated
+	int cache_policy;
+	object_list *clock_hand;
+	unsigned long hits, misses, evictions;
+	DECLARE_HASHTABLE(keys, KEY_HASH_BITS);
+	spinlock_t keys_lock;
+	watch_list *wlist;
+	int dedup; //objects are merged by the dedup scanner
+	unsigned long cold_ms; //objects unused this long get compressed, 0 if never
+	unsigned long inflates;
+	u64 inflate_ns;
 	struct container_list* next;
 }container_list;
 
+/**
+ * An arena window binds every slot it touches to one object for its whole
+ * lifetime, holding a mapping reference on it, so the window keeps seeing
+ * the same memory even if the object is freed or evicted meanwhile.
+ */
+typedef struct arena_map
+{
+	container_list *container;
+	unsigned long first; //oid of the first slot covered by the window
+	unsigned long count;
+	int users; //vmas sharing this window after fork or split
+	int writable; //window may write, so it cannot bind published objects
+	object_list **objects;
+}arena_map;
+
 container_list* head = NULL;
+object_data* published = NULL;
+
+#define TASK_HASH_BITS 8
+static DEFINE_HASHTABLE(task_map, TASK_HASH_BITS);
 
 static DEFINE_MUTEX(mutex);
 
+/**
+ * Memory of released objects is handed to a work item so that freeing
+ * megabytes never happens under the global mutex.
+ */
+static LLIST_HEAD(reclaim_list);
+static void reclaim_data(struct work_struct *work);
+static DECLARE_WORK(reclaim_work, reclaim_data);
+
+/**
+ * Dedup scanner. Every dedup_interval ms it hashes up to dedup_rate unmapped
+ * objects of the containers that opted in, so its CPU cost is bounded no
+ * matter how much memory the containers hold.
+ */
+#define DEDUP_HASH_BITS 10
+
+static unsigned int dedup_rate = 64;
+module_param(dedup_rate, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(dedup_rate, "objects hashed per dedup pass");
+static unsigned int dedup_interval = 1000;
+module_param(dedup_interval, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(dedup_interval, "milliseconds between dedup passes");
+
+static DEFINE_HASHTABLE(dedup_table, DEDUP_HASH_BITS);
+static int dedup_containers; //containers that opted in
+static void dedup_scan(struct work_struct *work);
+static DECLARE_DELAYED_WORK(dedup_work, dedup_scan);
+
+/**
+ * Compressor. Every compress_interval ms it compresses up to compress_rate
+ * objects that nobody mapped or touched for the cold interval of their
+ * container; they are decompressed again by the next access.
+ */
+static unsigned int compress_rate = 16;
+module_param(compress_rate, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(compress_rate, "objects compressed per pass");
+static unsigned int compress_interval = 1000;
+module_param(compress_interval, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(compress_interval, "milliseconds between compression passes");
+
+static void *compress_wrkmem;
+static int compress_containers; //containers with a cold interval
+static void compress_scan(struct work_struct *work);
+static DECLARE_DELAYED_WORK(compress_work, compress_scan);
+
+static const struct vm_operations_struct object_vm_ops;
+
 object_list* findobject(unsigned long id, container_list *container)
 {
 	container_list *temp = container, *result = NULL;
@@ -96,28 +277,85 @@ object_list* findobject(unsigned long id, container_list *container)
 }
 
 
+/***findcontainer() returns the container of a task; it needs no lock since containers live until the module is unloaded***/
 container_list* findcontainer(struct task_struct *c)
 {
-	
-	container_list *temp = head, *result = NULL;
-	while(temp!=NULL)
+	process_list *p;
+	container_list *result = NULL;
+
+	rcu_read_lock();
+	hash_for_each_possible_rcu(task_map, p, tnode, (unsigned long)c)
 	{
-		process_list *processHead = temp->list;
-		while(processHead!=NULL)
+		if(p->process == c)
 		{
-			if(processHead->process->pid == c->pid)
-			{
-				result = temp;
-				return result;
-			}
-			processHead = processHead->next;
+			result = p->container;
+			break;
 		}
-		temp = temp->next;
+	}
+	rcu_read_unlock();
+	return result;
+}
+
+
+process_list* findprocess(struct task_struct *c, container_list *container)
+{
+	process_list *processHead = container->list;
+	while(processHead!=NULL)
+	{
+		if(processHead->process == c)
+			return processHead;
+		processHead = processHead->next;
 	}
 	return NULL;
 }
 
 
+/***newprocess() allocates a process list entry for the calling task joining container***/
+process_list* newprocess(container_list *container)
+{
+	process_list *p = (process_list *)kmalloc(sizeof(process_list), GFP_KERNEL);
+
+	if(p == NULL)
+		return NULL;
+	get_task_struct(current);
+	p->process = current;
+	p->last_miss = 0;
+	p->container = container;
+	p->next = NULL;
+	hash_add_rcu(task_map, &p->tnode, (unsigned long)current);
+	return p;
+}
+
+
+/***initcontainer() sets up an empty container with the given id***/
+void initcontainer(container_list *container, int cid)
+{
+	container->cid = cid;
+	container->next = NULL;
+	container->list = NULL;
+	container->olist = NULL;
+	container->llist = NULL;
+	container->arena_objects = 0;
+	container->arena_size = 0;
+	container->arena_addr = 0;
+	init_waitqueue_head(&container->wq);
+	container->cache_budget = 0;
+	container->cache_bytes = 0;
+	container->cache_policy = MCONTAINER_EVICT_CLOCK;
+	container->clock_hand = NULL;
+	container->hits = 0;
+	container->misses = 0;
+	container->evictions = 0;
+	hash_init(container->keys);
+	spin_lock_init(&container->keys_lock);
+	container->wlist = NULL;
+	container->dedup = 0;
+	container->cold_ms = 0;
+	container->inflates = 0;
+	container->inflate_ns = 0;
+}
+
+
 lock_list* findlock(unsigned long id, container_list *container)
 {
 	container_list *temp = container, *result = NULL;
@@ -162,285 +400,2295 @@ void print_container(void)
 }
 
 
-int memory_container_mmap(struct file *filp, struct vm_area_struct *vma)
+/***emptydata() allocates the bookkeeping for object memory that is not populated yet***/
+object_data* emptydata(unsigned long size)
 {
-	mutex_lock(&mutex);
-	//printk("\nEntering mmap");
-	container_list *container = findcontainer(current);
-	//printk("\nFound container %d", container->cid);
-	object_list *o = findobject(vma->vm_pgoff, container);
-	//printk("\nPage Offset: %d", vma->vm_pgoff);
+	object_data *d = (object_data *)kmalloc(sizeof(object_data), GFP_KERNEL);
 
-	if(o == NULL)
-	{
-		object_list *new, *current_object = container->olist, *prev = NULL;
-		unsigned long oid = vma->vm_pgoff;
-		int flag = 0;
-		
-		while(current_object!=NULL)
-		{		
-			prev = current_object;
-			current_object = current_object->next;
-		}
+	if(d == NULL)
+		return NULL;
+	d->virt_addr = NULL;
+	d->pfn = 0;
+	d->size = size;
+	d->refs = 1;
+	d->readonly = 0;
+	d->name = 0;
+	d->next = NULL;
+	d->hashed = 0;
+	d->zdata = NULL;
+	d->zsize = 0;
+	d->pins = 0;
+	d->writes = 0;
+	return d;
+}
 
-		char *data = (char*)kcalloc(1, (vma->vm_end-vma->vm_start)*sizeof(char), GFP_KERNEL);
-		unsigned long pfn = virt_to_phys((void*)data)>>PAGE_SHIFT;
-		remap_pfn_range(vma, vma->vm_start, pfn, vma->vm_end-vma->vm_start, vma->vm_page_prot);
-		//printk("\nCreated Object with ID: %d and PFN: %d", vma->vm_pgoff, pfn);
-		
-		new = (object_list *)kmalloc(sizeof(object_list), GFP_KERNEL);
-		new->pfn = pfn;
-		new->virt_addr = data;
-		new->oid = vma->vm_pgoff;
-		new->next = NULL;
-		if(prev == NULL)
-			container->olist = new;
-		else
-			prev->next = new;
-		//printk("Object added to the list");
+
+/***allocdata() allocates zeroed memory for an object***/
+object_data* allocdata(unsigned long size)
+{
+	object_data *d = emptydata(size);
+
+	if(d == NULL)
+		return NULL;
+	d->virt_addr = (char*)kcalloc(1, size*sizeof(char), GFP_KERNEL);
+	if(d->virt_addr == NULL)
+	{
+		kfree(d);
+		return NULL;
 	}
+	d->pfn = virt_to_phys((void*)d->virt_addr)>>PAGE_SHIFT;
+	return d;
+}
 
-	else if(o->oid == vma->vm_pgoff)
+
+/***unhashdata() takes memory out of the dedup table before its contents may change***/
+void unhashdata(object_data *d)
+{
+	if(d->hashed)
 	{
-		//printk("\nFound Object with ID: %d and PFN: %d", o->oid, o->pfn);
-		remap_pfn_range(vma, vma->vm_start, o->pfn, vma->vm_end-vma->vm_start, vma->vm_page_prot);
-		mutex_unlock(&mutex);
-		return 0;
+		hash_del(&d->dnode);
+		d->hashed = 0;
 	}
+}
 
-	//printk("\nExiting mmap");
-	print_container();
-	mutex_unlock(&mutex);
-	return 0;
+
+/***reclaimdata() queues memory with no references left to be freed by reclaim_data()***/
+static void reclaimdata(object_data *d)
+{
+	if(llist_add(&d->reclaim, &reclaim_list)) //first on the list, nobody scheduled the work yet
+		schedule_work(&reclaim_work);
 }
 
 
-int memory_container_lock(struct memory_container_cmd __user *user_cmd)
+/***putdata() drops an object's reference to its memory, freeing it with the last one***/
+void putdata(object_data *d)
 {
-	mutex_lock(&mutex);
-	//printk("\nEntering lock");
-	container_list *container = findcontainer(current);
-	//printk("\nFound container %d", container->cid);
-	struct memory_container_cmd c;
-	copy_from_user(&c,user_cmd, sizeof(c)); //fetch container Id from user space
-	unsigned long object_id = (int)c.oid;
-	//printk("\nObject ID: %d", object_id);
-	lock_list *lock = findlock(object_id, container);
-	if(lock == NULL)
+	object_data **p;
+
+	if(--d->refs > 0)
+		return;
+	unhashdata(d);
+	if(d->readonly)
 	{
-		//create lock
-		lock_list *new, *current_lock = container->llist, *prev = NULL;
-		
-		while(current_lock!=NULL)
-		{		
-			prev = current_lock;
-			current_lock = current_lock->next;
+		for(p = &published; *p != NULL; p = &(*p)->next)
+		{
+			if(*p == d)
+			{
+				*p = d->next;
+				break;
+			}
 		}
-
-		new = (lock_list *)kmalloc(sizeof(lock_list), GFP_KERNEL);
-		new->oid = object_id;
-		mutex_init(&new->mutex_lock);
-		new->next = NULL;
-		if(prev == NULL)
-			container->llist = new;
-		else
-			prev->next = new;
-		lock = new;
-		//printk("\nCreated lock");
 	}
-	print_container();
-	mutex_unlock(&mutex);
-	//printk("\nProcess %d Mutex is %d", current->pid, mutex_is_locked(&lock->mutex_lock));
-	mutex_lock(&lock->mutex_lock);
-	//printk("\nProcess %d accquired mutex is %d", current->pid, mutex_is_locked(&lock->mutex_lock));
-	//printk("\nExiting lock");
-	return 0;
+	if(d->pins == 0)
+		reclaimdata(d);
 }
 
 
-int memory_container_unlock(struct memory_container_cmd __user *user_cmd)
+/***unpindata() lets go of memory the dedup scanner was reading, freeing it if it lost its last reference meanwhile***/
+static void unpindata(object_data *d)
 {
-	mutex_lock(&mutex);
-	//printk("\nEntering unlock for process: %d", current->pid);
-	container_list *container = findcontainer(current);
-	struct memory_container_cmd c;
-	copy_from_user(&c,user_cmd, sizeof(c)); //fetch container Id from user space
-	unsigned long object_id = (int)c.oid;
-	lock_list *current_lock = findlock(object_id, container);
-	mutex_unlock(&current_lock->mutex_lock);
-	mutex_unlock(&mutex);
-	//printk("\nExiting unlock");
-	return 0;
+	if(--d->pins == 0 && d->refs == 0)
+		reclaimdata(d);
 }
 
 
-int memory_container_delete(struct memory_container_cmd __user *user_cmd)
-{	
-	mutex_lock(&mutex);
-	//printk("\nEntering delete for process: %d", current->pid);
+/***reclaim_data() frees the memory putdata() queued, outside the global mutex***/
+static void reclaim_data(struct work_struct *work)
+{
+	struct llist_node *list = llist_del_all(&reclaim_list);
+	object_data *d, *tmp;
 
-	container_list *current_container = findcontainer(current);
-	process_list *current_process = current_container->list, *prev_process = NULL;
-	while(current_process->process->pid != current->pid)
+	llist_for_each_entry_safe(d, tmp, list, reclaim)
 	{
-		prev_process = current_process;
-		current_process = current_process->next;		
+		kfree(d->virt_addr);
+		vfree(d->zdata);
+		kfree(d);
 	}
-	//printk("\nFound process: %d", current_process->process->pid);	
-	if(prev_process == NULL)
-		current_container->list = current_process->next;
-	else
-		prev_process->next = current_process->next;
-	kfree(current_process);
-	//current_process = NULL;
+}
 
-	//printk("\nExiting delete");
-	print_container();
-	mutex_unlock(&mutex);
+
+/***unshareobject() gives an object a private copy of memory merged by the dedup scanner before it is mapped or written***/
+int unshareobject(object_list *o)
+{
+	object_data *d = o->data, *copy;
+
+	d->writes++;
+	if(d->refs == 1)
+	{
+		unhashdata(d);
+		return 0;
+	}
+	copy = allocdata(d->size);
+	if(copy == NULL)
+		return -ENOMEM;
+	memcpy(copy->virt_addr, d->virt_addr, d->size);
+	o->data = copy;
+	putdata(d);
 	return 0;
 }
 
 
-void delete_all(void){
-	container_list *c=NULL,*current_container = head;
-	object_list *o = NULL, *current_object = current_container->olist;
-	lock_list *l = NULL, *current_lock = current_container->llist;
-	while(current_container!=NULL)
+/***deflatedata() compresses memory into a new buffer in *z if that saves enough; it runs outside the mutex***/
+static int deflatedata(object_data *d, unsigned char **z, size_t *zsize)
+{
+	unsigned char *buf;
+
+	*z = NULL;
+	*zsize = lz4_compressbound(d->size);
+	if(compress_wrkmem == NULL)
+		compress_wrkmem = kmalloc(LZ4_MEM_COMPRESS, GFP_KERNEL);
+	buf = vmalloc(*zsize);
+	if(buf == NULL || compress_wrkmem == NULL)
 	{
-		current_object = current_container->olist;
-		current_lock = current_container->llist;
-		while(current_object != NULL)
-		{
-			o = current_object;
-			current_object = current_object->next;
-			kfree(o->virt_addr);
-			o->virt_addr = NULL;
-			kfree(o);
-			o->virt_addr = NULL;
-		}
-		while(current_lock != NULL)
-		{
-			l = current_lock;
-			current_lock = current_lock->next;
-			kfree(l);
-			l = NULL;
-		}
-		c = current_container;
-		current_container = current_container->next;
-		kfree(c);
-		c = NULL;
+		vfree(buf);
+		return -ENOMEM;
 	}
+	if(lz4_compress(d->virt_addr, d->size, buf, zsize, compress_wrkmem) == 0 && *zsize < d->size - d->size / 8)
+		*z = vmalloc(*zsize);
+	if(*z != NULL)
+		memcpy(*z, buf, *zsize);
+	vfree(buf);
+	return 0;
 }
 
 
-int memory_container_create(struct processor_container_cmd __user *user_cmd)
+/***residentobject() decompresses or repopulates an object's memory if needed before it is used and marks it used***/
+static int residentobject(object_list *o, container_list *container)
 {
-	mutex_lock(&mutex);
-	int container_id, object_id;
-	struct memory_container_cmd container;
-	copy_from_user(&container,user_cmd, sizeof(container)); //fetch container Id from user space
-	container_id = (int)container.cid;
-	//printk("\nEntering create Pid: %d Tgid: %d Container ID: %d Object ID: %d", current->pid, current->tgid, container_id, object_id);
-	if(head == NULL) //create new container if no container exists
+	object_data *d = o->data;
+	size_t zsize = d->zsize;
+	u64 start;
+	char *addr;
+
+	o->last_used = jiffies;
+	if(d->virt_addr != NULL)
+		return 0;
+	if(d->zdata == NULL) //released by DONTNEED
 	{
-		head = (container_list *)kmalloc(sizeof(container_list), GFP_KERNEL); //initialize container list
-		head->cid = container_id;
-		head->next = NULL;
-		process_list *phead = (process_list *)kmalloc(sizeof(process_list), GFP_KERNEL);// initialize container's process list
-		phead->next = NULL;
-		phead->process = current;
-		head->list = phead;
-		head->olist = NULL;
-		head->llist = NULL;
+		d->virt_addr = (char*)kcalloc(1, d->size, GFP_KERNEL);
+		if(d->virt_addr == NULL)
+			return -ENOMEM;
+		d->pfn = virt_to_phys((void*)d->virt_addr)>>PAGE_SHIFT;
+		return 0;
 	}
-	else 
+	start = ktime_get_ns();
+	addr = (char *)kmalloc(d->size, GFP_KERNEL);
+	if(addr == NULL)
+		return -ENOMEM;
+	if(lz4_decompress(d->zdata, &zsize, addr, d->size))
 	{
-		container_list *temp = head, *t = NULL;		
-		while(temp!=NULL)
-		{		
-			if(temp->cid == container_id)
-			{
-				process_list *phead = temp->list;
-				process_list *new = (process_list *)kmalloc(sizeof(process_list), GFP_KERNEL); 
-				new->next = NULL;
-				new->process = current;
-
-				if(phead == NULL)
-				{
-					temp->list = new;
-				}
-				else
-				{
-					while(phead->next!=NULL)
-						phead=phead->next;
- 
-					phead->next = new; //append process to an existing container
-				}
-				break;
-			}
-			t = temp;
-			temp = temp->next;
-		}
-		if(temp==NULL) //creating a new container and appending it to container list
-		{
-			container_list *new = (container_list *)kmalloc(sizeof(container_list), GFP_KERNEL);
-			new->cid = container_id;
-			new->next = NULL;
-			new->olist = NULL;
-			new->llist = NULL;
-			process_list *phead = (process_list *)kmalloc(sizeof(process_list), GFP_KERNEL);
-			phead->next = NULL;
-			phead->process = current;
-			new->list = phead;
-			t->next = new;
-		}
+		kfree(addr);
+		return -EIO;
 	}
+	vfree(d->zdata);
+	d->zdata = NULL;
+	d->zsize = 0;
+	d->virt_addr = addr;
+	d->pfn = virt_to_phys((void*)addr)>>PAGE_SHIFT;
+	container->inflates++;
+	container->inflate_ns += ktime_get_ns() - start;
+	return 0;
+}
 
-	
-	//printk("\nExiting create");
-	print_container();
-	mutex_unlock(&mutex);
+
+/***dropdata() releases the memory of an unmapped object, it reads as zeroes when used again***/
+static int dropdata(object_list *o)
+{
+	object_data *d = emptydata(o->data->size);
+
+	if(d == NULL)
+		return -ENOMEM;
+	putdata(o->data); //objects merged with it keep their copy, otherwise it is reclaimed
+	o->data = d;
 	return 0;
 }
 
 
-int memory_container_free(struct memory_container_cmd __user *user_cmd)
+/***releaseobject() returns the memory of an object that is no longer reachable***/
+void releaseobject(object_list *o)
 {
-	mutex_lock(&mutex);
-	struct memory_container_cmd c;
-	copy_from_user(&c,user_cmd, sizeof(c)); //fetch container Id from user space
-	unsigned long object_id = (int)c.oid;
-	container_list *container = findcontainer(current);
-	//printk("\nEntering free for process %d, container %d and object %d", current->pid, container->cid, object_id);
-	container_list *current_container = container, *prev_container = NULL;
-	object_list *current_object, *prev_object = NULL;
+	putdata(o->data);
+	o->data = NULL;
+	kfree(o);
+}
 
-	object_list *objectHead = current_container->olist;
-	while(objectHead!=NULL)
+
+/***unlinkobject() removes an object from the container's object list***/
+void unlinkobject(object_list *o, container_list *container)
+{
+	object_list *current_object = container->olist, *prev = NULL;
+
+	while(current_object != NULL && current_object != o)
 	{
-		if(objectHead->oid == object_id)
-		{
-			current_object = objectHead;				
-			if(prev_object == NULL)
-				current_container->olist = objectHead->next;
-			else
-				prev_object->next = objectHead->next;
-			kfree(current_object->virt_addr);
-			current_object->virt_addr = NULL;
-			kfree(current_object);
-			current_object = NULL;
-			break;
+		prev = current_object;
+		current_object = current_object->next;
+	}
+	if(current_object == NULL)
+		return;
+	if(prev == NULL)
+		container->olist = o->next;
+	else
+		prev->next = o->next;
+	if(container->clock_hand == o)
+		container->clock_hand = o->next;
+	container->cache_bytes -= o->data->size;
+}
+
+
+/***dropobject() unlinks an object and frees it now, or once its last mapping goes away***/
+void dropobject(object_list *o, container_list *container)
+{
+	unlinkobject(o, container);
+	if(o->refs == 0)
+		releaseobject(o);
+	else
+		o->freed = 1;
+}
+
+
+/***getobjectref() takes a mapping reference for mmap or an arena window***/
+void getobjectref(object_list *o, int writable)
+{
+	o->refs++;
+	if(writable)
+		o->wrefs++;
+}
+
+
+/***putobject() drops a mapping reference taken by getobjectref()***/
+void putobject(object_list *o, int writable)
+{
+	if(writable)
+		o->wrefs--;
+	o->last_used = jiffies;
+	if(--o->refs == 0 && o->freed)
+		releaseobject(o);
+}
+
+
+/***cmpoid() orders oids for sort() and bsearch()***/
+static int cmpoid(const void *a, const void *b)
+{
+	u64 x = *(const u64 *)a, y = *(const u64 *)b;
+	return x < y ? -1 : x > y;
+}
+
+
+/***notifywatchers() marks object oid changed for every file watching it for event and wakes them***/
+static void notifywatchers(container_list *container, u64 oid, int event)
+{
+	watch_list *w;
+	u64 *slot;
+
+	for(w = container->wlist; w != NULL; w = w->next)
+	{
+		if(!(w->events & event))
+			continue;
+		slot = bsearch(&oid, w->oids, w->count, sizeof(u64), cmpoid);
+		if(slot == NULL)
+			continue;
+		if(!test_bit(slot - w->oids, w->pending))
+		{
+			__set_bit(slot - w->oids, w->pending);
+			w->npending++;
+		}
+		wake_up_interruptible(&w->wq);
+		if(w->eventfd != NULL)
+			eventfd_signal(w->eventfd, 1);
+	}
+}
+
+
+/***evictable() tells whether an object is neither mapped nor locked by anyone***/
+static int evictable(object_list *o, container_list *container)
+{
+	lock_list *lock = findlock(o->oid, container);
+	return o->refs == 0 && (lock == NULL || lock->owner == NULL);
+}
+
+
+/***releaselocks() hands on the locks task still holds in the container, marking them abandoned***/
+static void releaselocks(struct task_struct *task, container_list *container)
+{
+	lock_list *lock;
+
+	for(lock = container->llist; lock != NULL; lock = lock->next)
+	{
+		if(lock->owner != task)
+			continue;
+		lock->owner = NULL;
+		lock->abandoned = 1;
+		wake_up(&lock->wq);
+		notifywatchers(container, lock->oid, MCONTAINER_WATCH_UNLOCK);
+	}
+}
+
+
+static void freeprocess_rcu(struct rcu_head *rcu)
+{
+	process_list *p = container_of(rcu, process_list, rcu);
+
+	put_task_struct(p->process);
+	kfree(p);
+}
+
+
+/***task_exiting() hands on the locks of a member the moment it exits, even if its thread group lives on***/
+static int task_exiting(struct notifier_block *nb, unsigned long action, void *data)
+{
+	struct task_struct *task = data;
+	container_list *container = findcontainer(task);
+
+	if(container == NULL)
+		return NOTIFY_DONE;
+	mutex_lock(&mutex);
+	releaselocks(task, container);
+	mutex_unlock(&mutex);
+	return NOTIFY_OK;
+}
+
+static struct notifier_block exit_notifier = {
+	.notifier_call = task_exiting,
+};
+static int exits_watched; //exit_notifier is registered, lock waiters need not poll
+
+
+/***freeprocess() drops a task from a container once it is unlinked, releasing its locks***/
+static void freeprocess(process_list *p, container_list *container)
+{
+	releaselocks(p->process, container);
+	hash_del_rcu(&p->tnode);
+	call_rcu(&p->rcu, freeprocess_rcu);
+}
+
+
+/***prunetasks() drops exiting tasks, and with group every task of the caller's thread group, from all containers***/
+static void prunetasks(int group)
+{
+	container_list *container;
+	process_list **p, *dead;
+
+	for(container = head; container != NULL; container = container->next)
+	{
+		p = &container->list;
+		while(*p != NULL)
+		{
+			if(((*p)->process->flags & PF_EXITING) || (group && (*p)->process->tgid == current->tgid))
+			{
+				dead = *p;
+				*p = dead->next;
+				freeprocess(dead, container);
+			}
+			else
+				p = &(*p)->next;
+		}
+	}
+}
+
+
+/**
+ * Pick the next object to evict. With CLOCK the hand sweeps the object list
+ * giving referenced objects a second chance; with LRU the list is kept in
+ * access order so the first evictable object is the least recently used.
+ */
+static object_list* pickvictim(container_list *container)
+{
+	object_list *o;
+	unsigned long scanned = 0, limit = 0;
+
+	if(container->cache_policy == MCONTAINER_EVICT_LRU)
+	{
+		for(o = container->olist; o != NULL; o = o->next)
+			if(evictable(o, container))
+				return o;
+		return NULL;
+	}
+
+	for(o = container->olist; o != NULL; o = o->next)
+		limit++;
+	o = container->clock_hand;
+	while(scanned++ < 2 * limit) //two sweeps clear every reference bit
+	{
+		if(o == NULL)
+			o = container->olist;
+		if(evictable(o, container))
+		{
+			if(!o->referenced)
+			{
+				container->clock_hand = o->next;
+				return o;
+			}
+			o->referenced = 0;
+		}
+		o = o->next;
+	}
+	container->clock_hand = o;
+	return NULL;
+}
+
+
+/***makeroom() evicts objects of a cache container until size more bytes fit in its budget***/
+static int makeroom(unsigned long size, container_list *container)
+{
+	object_list *victim;
+
+	if(container->cache_budget == 0)
+		return 0;
+	while(container->cache_bytes + size > container->cache_budget)
+	{
+		victim = pickvictim(container);
+		if(victim == NULL)
+			return -ENOMEM;
+		//printk("\nEvicting object %d from container %d", victim->oid, container->cid);
+		dropobject(victim, container);
+		container->evictions++;
+	}
+	return 0;
+}
+
+
+/***touchobject() records an access for the replacement policy***/
+static void touchobject(object_list *o, container_list *container)
+{
+	if(o->advice == MCONTAINER_ADV_SEQUENTIAL) //not used again soon, let it go first
+	{
+		o->referenced = 0;
+		return;
+	}
+	o->referenced = 1;
+	if(container->cache_policy == MCONTAINER_EVICT_LRU && o->next != NULL)
+	{
+		object_list *tail = o;
+		unlinkobject(o, container);
+		container->cache_bytes += o->data->size;
+		while(tail->next != NULL)
+			tail = tail->next;
+		tail->next = o;
+		o->next = NULL;
+	}
+}
+
+
+/***linkobject() appends a new object backed by data to the container's object list***/
+object_list* linkobject(unsigned long id, object_data *data, container_list *container)
+{
+	object_list *new, *current_object = container->olist, *prev = NULL;
+
+	while(current_object!=NULL)
+	{
+		prev = current_object;
+		current_object = current_object->next;
+	}
+
+	new = (object_list *)kmalloc(sizeof(object_list), GFP_KERNEL);
+	if(new == NULL)
+	{
+		putdata(data);
+		return NULL;
+	}
+	new->data = data;
+	new->oid = id;
+	new->refs = 0;
+	new->wrefs = 0;
+	new->referenced = 1;
+	new->freed = 0;
+	new->version = 0;
+	new->last_used = jiffies;
+	new->advice = MCONTAINER_ADV_NORMAL;
+	new->container = container;
+	new->next = NULL;
+	if(prev == NULL)
+		container->olist = new;
+	else
+		prev->next = new;
+	container->cache_bytes += data->size;
+	//printk("\nCreated Object with ID: %d and PFN: %d", id, data->pfn);
+	return new;
+}
+
+
+/***allocobject() creates a zeroed object of the given size and appends it to the container's object list***/
+object_list* allocobject(unsigned long id, unsigned long size, container_list *container)
+{
+	object_data *data;
+
+	if(makeroom(size, container))
+		return NULL;
+	data = allocdata(size);
+	if(data == NULL)
+		return NULL;
+	return linkobject(id, data, container);
+}
+
+
+/***getobject() looks an object up for mapping, creating it on a miss, and counts the hit or miss***/
+object_list* getobject(unsigned long id, unsigned long size, container_list *container, int *miss)
+{
+	object_list *o = findobject(id, container);
+
+	*miss = (o == NULL);
+	if(o == NULL)
+	{
+		container->misses++;
+		return allocobject(id, size, container);
+	}
+	container->hits++;
+	touchobject(o, container);
+	if(residentobject(o, container))
+		return NULL;
+	if(o->advice == MCONTAINER_ADV_SEQUENTIAL)
+	{
+		//read the next object ahead so its decompression is off the next access
+		object_list *next = findobject(id + 1, container);
+		if(next != NULL && next->data->zdata != NULL)
+			residentobject(next, container);
+	}
+	return o;
+}
+
+
+/***arena_pfn() returns the pfn backing page pgoff of the arena window, creating the object on first touch***/
+static int arena_pfn(arena_map *a, unsigned long pgoff, unsigned long *pfn)
+{
+	container_list *container = a->container;
+	unsigned long offset = (pgoff - MCONTAINER_ARENA_PGOFF) << PAGE_SHIFT;
+	unsigned long id = offset / container->arena_size;
+	object_list *o;
+	int miss;
+
+	if(id < a->first || id - a->first >= a->count)
+		return -EINVAL;
+	o = a->objects[id - a->first];
+	if(o == NULL)
+	{
+		o = getobject(id, container->arena_size, container, &miss);
+		if(o == NULL)
+			return -ENOMEM;
+		if(o->data->readonly && a->writable)
+			return -EACCES;
+		//read-only windows too, a mapped object is never merged again and so never moves to a new copy
+		if(!o->data->readonly && unshareobject(o))
+			return -ENOMEM;
+		getobjectref(o, a->writable);
+		a->objects[id - a->first] = o;
+	}
+	offset -= id * container->arena_size;
+	if(offset >= o->data->size) //object was created smaller than an arena slot
+		return -EINVAL;
+	*pfn = o->data->pfn + (offset >> PAGE_SHIFT);
+	return 0;
+}
+
+
+/***arena_fault() populates one page of an arena window with the object that lives there***/
+static int arena_fault(struct vm_area_struct *vma, struct vm_fault *vmf)
+{
+	unsigned long pfn;
+	int ret;
+
+	mutex_lock(&mutex);
+	ret = arena_pfn(vma->vm_private_data, vmf->pgoff, &pfn);
+	mutex_unlock(&mutex);
+	if(ret == -ENOMEM)
+		return VM_FAULT_OOM;
+	if(ret)
+		return VM_FAULT_SIGBUS;
+
+	ret = vm_insert_pfn(vma, (unsigned long)vmf->virtual_address & PAGE_MASK, pfn);
+	if(ret && ret != -EBUSY) //-EBUSY means a concurrent fault already mapped it
+		return VM_FAULT_SIGBUS;
+	return VM_FAULT_NOPAGE;
+}
+
+
+static void arena_open(struct vm_area_struct *vma)
+{
+	arena_map *a = vma->vm_private_data;
+
+	mutex_lock(&mutex);
+	a->users++;
+	mutex_unlock(&mutex);
+}
+
+
+static void arena_close(struct vm_area_struct *vma)
+{
+	arena_map *a = vma->vm_private_data;
+	unsigned long i;
+
+	mutex_lock(&mutex);
+	if(--a->users == 0)
+	{
+		for(i = 0; i < a->count; i++)
+		{
+			if(a->objects[i] == NULL)
+				continue;
+			if(a->writable)
+				notifywatchers(a->container, a->objects[i]->oid, MCONTAINER_WATCH_WRITE);
+			putobject(a->objects[i], a->writable);
+		}
+		kfree(a->objects);
+		kfree(a);
+	}
+	mutex_unlock(&mutex);
+}
+
+
+static const struct vm_operations_struct arena_vm_ops = {
+	.open = arena_open,
+	.close = arena_close,
+	.fault = arena_fault,
+};
+
+
+/***arena_mmap() sets up a window over the container's arena; pages are populated on fault***/
+static int arena_mmap(container_list *container, struct vm_area_struct *vma)
+{
+	unsigned long start = (vma->vm_pgoff - MCONTAINER_ARENA_PGOFF) << PAGE_SHIFT;
+	unsigned long end = start + (vma_pages(vma) << PAGE_SHIFT);
+	arena_map *a;
+
+	if(container->arena_objects == 0 || !(vma->vm_flags & VM_SHARED))
+		return -EINVAL;
+	if(end > container->arena_objects * container->arena_size)
+		return -EINVAL;
+	//in a fixed-address container pointers stored in objects are only valid at the agreed address
+	if(container->arena_addr && vma->vm_start != container->arena_addr + start)
+		return -EINVAL;
+
+	a = (arena_map *)kmalloc(sizeof(arena_map), GFP_KERNEL);
+	if(a == NULL)
+		return -ENOMEM;
+	a->container = container;
+	a->first = start / container->arena_size;
+	a->count = DIV_ROUND_UP(end, container->arena_size) - a->first;
+	a->users = 1;
+	a->writable = !!(vma->vm_flags & VM_MAYWRITE);
+	a->objects = (object_list **)kcalloc(a->count, sizeof(object_list *), GFP_KERNEL);
+	if(a->objects == NULL)
+	{
+		kfree(a);
+		return -ENOMEM;
+	}
+	vma->vm_flags |= VM_PFNMAP | VM_DONTEXPAND | VM_DONTDUMP;
+	vma->vm_ops = &arena_vm_ops;
+	vma->vm_private_data = a;
+	return 0;
+}
+
+
+static void object_open(struct vm_area_struct *vma)
+{
+	mutex_lock(&mutex);
+	getobjectref(vma->vm_private_data, !!(vma->vm_flags & VM_MAYWRITE));
+	mutex_unlock(&mutex);
+}
+
+
+static void object_close(struct vm_area_struct *vma)
+{
+	object_list *o = vma->vm_private_data;
+
+	mutex_lock(&mutex);
+	if(vma->vm_flags & VM_MAYWRITE)
+		notifywatchers(o->container, o->oid, MCONTAINER_WATCH_WRITE);
+	putobject(o, !!(vma->vm_flags & VM_MAYWRITE));
+	mutex_unlock(&mutex);
+}
+
+
+static const struct vm_operations_struct object_vm_ops = {
+	.open = object_open,
+	.close = object_close,
+};
+
+
+int memory_container_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+	container_list *container;
+	process_list *process;
+	object_list *o;
+	unsigned long size = vma->vm_end - vma->vm_start;
+	int ret = 0, miss;
+
+	mutex_lock(&mutex);
+	//printk("\nEntering mmap");
+	container = findcontainer(current);
+	if(container == NULL)
+	{
+		mutex_unlock(&mutex);
+		return -EINVAL;
+	}
+	if(vma->vm_pgoff >= MCONTAINER_ARENA_PGOFF)
+	{
+		ret = arena_mmap(container, vma);
+		mutex_unlock(&mutex);
+		return ret;
+	}
+	//printk("\nFound container %d", container->cid);
+	o = getobject(vma->vm_pgoff, size, container, &miss);
+	//printk("\nPage Offset: %d", vma->vm_pgoff);
+	if(o == NULL)
+		ret = -ENOMEM;
+	else if(size > o->data->size)
+		ret = -EINVAL;
+	else if(o->data->readonly)
+	{
+		//published objects can only be mapped read-only, and never made writable later
+		if(vma->vm_flags & VM_WRITE)
+			ret = -EACCES;
+		vma->vm_flags &= ~VM_MAYWRITE;
+	}
+	else
+		ret = unshareobject(o); //read-only too, or a later CWRITE would move the object off the pages mapped here
+
+	if(ret == 0)
+	{
+		//printk("\nFound Object with ID: %d and PFN: %d", o->oid, o->data->pfn);
+		ret = remap_pfn_range(vma, vma->vm_start, o->data->pfn, size, vma->vm_page_prot);
+	}
+	if(ret == 0)
+	{
+		getobjectref(o, !!(vma->vm_flags & VM_MAYWRITE));
+		vma->vm_ops = &object_vm_ops;
+		vma->vm_private_data = o;
+		process = findprocess(current, container);
+		process->last_miss = miss;
+	}
+
+	//printk("\nExiting mmap");
+	print_container();
+	mutex_unlock(&mutex);
+	return ret;
+}
+
+
+/**
+ * Set (or query, when size is 0) the geometry of the arena of the caller's
+ * container. Every member has to agree on the object size and count. The
+ * member that sets the geometry up first decides whether the container is
+ * fixed-address: with a non-zero addr every member then has to map the
+ * arena at exactly that address, and mmap fails anywhere else. Without one
+ * the arena can be mapped anywhere and cannot be pinned later.
+ */
+int memory_container_arena(struct memory_container_cmd __user *user_cmd)
+{
+	container_list *container;
+	struct memory_container_cmd c;
+	unsigned long size;
+	int ret = 0;
+
+	if(copy_from_user(&c, user_cmd, sizeof(c)))
+		return -EFAULT;
+	size = PAGE_ALIGN(c.size);
+	if(c.addr & ~PAGE_MASK)
+		return -EINVAL;
+
+	mutex_lock(&mutex);
+	container = findcontainer(current);
+	if(container == NULL)
+		ret = -EINVAL;
+	else if(c.size == 0)
+	{
+		if(container->arena_objects == 0)
+			ret = -ENOENT;
+	}
+	else if(container->arena_objects == 0)
+	{
+		container->arena_objects = c.oid;
+		container->arena_size = size;
+		container->arena_addr = c.addr;
+	}
+	else if(container->arena_objects != c.oid || container->arena_size != size)
+		ret = -EINVAL;
+	else if(c.addr && c.addr != container->arena_addr)
+		ret = -EINVAL;
+	if(ret == 0)
+	{
+		c.oid = container->arena_objects;
+		c.size = container->arena_size;
+		c.addr = container->arena_addr;
+	}
+	mutex_unlock(&mutex);
+
+	if(ret == 0 && copy_to_user(user_cmd, &c, sizeof(c)))
+		ret = -EFAULT;
+	return ret;
+}
+
+
+/***prefaultwindow() populates the caller's arena window at addr for objects [first, first + count)***/
+static int prefaultwindow(unsigned long addr, unsigned long first, unsigned long count)
+{
+	container_list *container;
+	struct vm_area_struct *vma;
+	arena_map *a;
+	unsigned long id, last, address, end, pfn;
+	int ret = 0;
+
+	down_read(&current->mm->mmap_sem);
+	vma = find_vma(current->mm, addr);
+	if(vma == NULL || vma->vm_start > addr || vma->vm_ops != &arena_vm_ops)
+	{
+		up_read(&current->mm->mmap_sem);
+		return -EINVAL;
+	}
+	a = vma->vm_private_data;
+	container = a->container;
+
+	mutex_lock(&mutex);
+	if(first >= container->arena_objects)
+	{
+		mutex_unlock(&mutex);
+		up_read(&current->mm->mmap_sem);
+		return -EINVAL;
+	}
+	//only the slots of the arena this window covers can be populated
+	count = min(count, container->arena_objects - first);
+	last = min(first + count, a->first + a->count);
+	for(id = max(first, a->first); id < last && ret == 0; id++)
+	{
+		//arena address of the object relative to the start of this window
+		address = vma->vm_start + id * container->arena_size - ((vma->vm_pgoff - MCONTAINER_ARENA_PGOFF) << PAGE_SHIFT);
+		end = address + container->arena_size;
+		if(address < vma->vm_start || end > vma->vm_end)
+			continue;
+		for(; address < end && ret == 0; address += PAGE_SIZE)
+		{
+			ret = arena_pfn(a, linear_page_index(vma, address), &pfn);
+			if(ret == -EINVAL) //tail of an object smaller than the slot
+			{
+				ret = 0;
+				break;
+			}
+			if(ret == 0)
+				ret = vm_insert_pfn(vma, address, pfn);
+			if(ret == -EBUSY)
+				ret = 0;
+		}
+	}
+	mutex_unlock(&mutex);
+	up_read(&current->mm->mmap_sem);
+	return ret;
+}
+
+
+/**
+ * Populate the page tables of the caller's arena window at addr for objects
+ * [oid, oid + size) so that touching them does not fault.
+ */
+int memory_container_prefault(struct memory_container_cmd __user *user_cmd)
+{
+	struct memory_container_cmd c;
+
+	if(copy_from_user(&c, user_cmd, sizeof(c)))
+		return -EFAULT;
+	return prefaultwindow(c.addr, c.oid, c.size);
+}
+
+
+/**
+ * Take the lock of object c.oid, sleeping while another task holds it.
+ * Returns -EOWNERDEAD, with the lock taken, if its last owner exited while
+ * holding it, so the caller knows the object may be inconsistent.
+ */
+int memory_container_lock(struct memory_container_cmd __user *user_cmd)
+{
+	DEFINE_WAIT(wait);
+	int ret = 0;
+	mutex_lock(&mutex);
+	//printk("\nEntering lock");
+	container_list *container = findcontainer(current);
+	if(container == NULL)
+	{
+		mutex_unlock(&mutex);
+		return -EINVAL;
+	}
+	//printk("\nFound container %d", container->cid);
+	struct memory_container_cmd c;
+	copy_from_user(&c,user_cmd, sizeof(c)); //fetch container Id from user space
+	unsigned long object_id = (int)c.oid;
+	//printk("\nObject ID: %d", object_id);
+	lock_list *lock = findlock(object_id, container);
+	if(lock == NULL)
+	{
+		//create lock
+		lock_list *new, *current_lock = container->llist, *prev = NULL;
+		
+		while(current_lock!=NULL)
+		{		
+			prev = current_lock;
+			current_lock = current_lock->next;
+		}
+
+		new = (lock_list *)kmalloc(sizeof(lock_list), GFP_KERNEL);
+		if(new == NULL)
+		{
+			mutex_unlock(&mutex);
+			return -ENOMEM;
+		}
+		new->oid = object_id;
+		new->owner = NULL;
+		new->abandoned = 0;
+		init_waitqueue_head(&new->wq);
+		new->next = NULL;
+		if(prev == NULL)
+			container->llist = new;
+		else
+			prev->next = new;
+		lock = new;
+		//printk("\nCreated lock");
+	}
+	print_container();
+	//printk("\nProcess %d waiting for lock owned by %d", current->pid, lock->owner ? lock->owner->pid : 0);
+	while(lock->owner != NULL && !(lock->owner->flags & PF_EXITING))
+	{
+		prepare_to_wait_exclusive(&lock->wq, &wait, TASK_KILLABLE);
+		mutex_unlock(&mutex);
+		//an owner exiting in a live thread group never flushes, without exit notifications recheck it
+		schedule_timeout(exits_watched ? MAX_SCHEDULE_TIMEOUT : HZ / 10);
+		finish_wait(&lock->wq, &wait);
+		if(fatal_signal_pending(current))
+		{
+			wake_up(&lock->wq); //the wakeup we may have consumed is owed to the next waiter
+			return -EINTR;
+		}
+		mutex_lock(&mutex);
+	}
+	if(lock->owner != NULL)
+		lock->abandoned = 1;
+	lock->owner = current;
+	if(lock->abandoned)
+	{
+		lock->abandoned = 0;
+		ret = -EOWNERDEAD;
+	}
+	mutex_unlock(&mutex);
+	//printk("\nExiting lock");
+	return ret;
+}
+
+
+int memory_container_unlock(struct memory_container_cmd __user *user_cmd)
+{
+	mutex_lock(&mutex);
+	//printk("\nEntering unlock for process: %d", current->pid);
+	container_list *container = findcontainer(current);
+	struct memory_container_cmd c;
+	copy_from_user(&c,user_cmd, sizeof(c)); //fetch container Id from user space
+	unsigned long object_id = (int)c.oid;
+	lock_list *current_lock = container == NULL ? NULL : findlock(object_id, container);
+	if(current_lock == NULL || current_lock->owner != current)
+	{
+		mutex_unlock(&mutex);
+		return -EPERM;
+	}
+	current_lock->owner = NULL;
+	wake_up(&current_lock->wq);
+	notifywatchers(container, object_id, MCONTAINER_WATCH_UNLOCK);
+	mutex_unlock(&mutex);
+	//printk("\nExiting unlock");
+	return 0;
+}
+
+
+int memory_container_delete(struct memory_container_cmd __user *user_cmd)
+{	
+	mutex_lock(&mutex);
+	//printk("\nEntering delete for process: %d", current->pid);
+
+	container_list *current_container = findcontainer(current);
+	if(current_container == NULL)
+	{
+		mutex_unlock(&mutex);
+		return -EINVAL;
+	}
+	process_list *current_process = current_container->list, *prev_process = NULL;
+	while(current_process->process != current)
+	{
+		prev_process = current_process;
+		current_process = current_process->next;		
+	}
+	//printk("\nFound process: %d", current_process->process->pid);	
+	if(prev_process == NULL)
+		current_container->list = current_process->next;
+	else
+		prev_process->next = current_process->next;
+	freeprocess(current_process, current_container);
+	//current_process = NULL;
+
+	//printk("\nExiting delete");
+	print_container();
+	mutex_unlock(&mutex);
+	return 0;
+}
+
+
+/**
+ * Ask to be told about every exiting task so that the locks of members are
+ * handed on at once. Kernels built without CONFIG_PROFILING cannot tell
+ * us; lock waiters then poll their owner instead.
+ */
+void memory_container_lock_init(void)
+{
+	exits_watched = profile_event_register(PROFILE_TASK_EXIT, &exit_notifier) == 0;
+	if(!exits_watched)
+		printk(KERN_WARNING "memory_container: no exit notifications, lock waiters will poll\n");
+}
+
+
+void memory_container_lock_exit(void)
+{
+	if(exits_watched)
+		profile_event_unregister(PROFILE_TASK_EXIT, &exit_notifier);
+	exits_watched = 0;
+}
+
+
+void delete_all(void){
+	container_list *c=NULL,*current_container = head;
+	object_list *o = NULL, *current_object = NULL;
+	lock_list *l = NULL, *current_lock = NULL;
+	process_list *p;
+	key_entry *k;
+	struct hlist_node *tmp;
+	int bkt;
+
+	cancel_delayed_work_sync(&dedup_work);
+	cancel_delayed_work_sync(&compress_work);
+	kfree(compress_wrkmem);
+	head = NULL;
+	while(current_container!=NULL)
+	{
+		current_object = current_container->olist;
+		current_lock = current_container->llist;
+		while(current_object != NULL)
+		{
+			o = current_object;
+			current_object = current_object->next;
+			releaseobject(o);
+		}
+		while(current_lock != NULL)
+		{
+			l = current_lock;
+			current_lock = current_lock->next;
+			kfree(l);
+			l = NULL;
+		}
+		hash_for_each_safe(current_container->keys, bkt, tmp, k, node)
+		{
+			hash_del(&k->node);
+			kfree(k);
+		}
+		while(current_container->list != NULL)
+		{
+			p = current_container->list;
+			current_container->list = p->next;
+			hash_del(&p->tnode);
+			put_task_struct(p->process);
+			kfree(p);
+		}
+		c = current_container;
+		current_container = current_container->next;
+		kfree(c);
+		c = NULL;
+	}
+	rcu_barrier(); //memberships freed by freeprocess() call back into the module
+	flush_work(&reclaim_work); //object memory queued above, the work must be done before the module goes
+}
+
+
+int memory_container_create(struct processor_container_cmd __user *user_cmd)
+{
+	mutex_lock(&mutex);
+	int container_id, object_id;
+	struct memory_container_cmd container;
+	copy_from_user(&container,user_cmd, sizeof(container)); //fetch container Id from user space
+	container_id = (int)container.cid;
+	//printk("\nEntering create Pid: %d Tgid: %d Container ID: %d Object ID: %d", current->pid, current->tgid, container_id, object_id);
+	prunetasks(0); //threads that exited without deleting themselves
+	if(head == NULL) //create new container if no container exists
+	{
+		head = (container_list *)kmalloc(sizeof(container_list), GFP_KERNEL); //initialize container list
+		initcontainer(head, container_id);
+		process_list *phead = newprocess(head);// initialize container's process list
+		head->list = phead;
+	}
+	else 
+	{
+		container_list *temp = head, *t = NULL;		
+		while(temp!=NULL)
+		{		
+			if(temp->cid == container_id)
+			{
+				process_list *phead = temp->list;
+				process_list *new = newprocess(temp);
+
+				if(phead == NULL)
+				{
+					temp->list = new;
+				}
+				else
+				{
+					while(phead->next!=NULL)
+						phead=phead->next;
+ 
+					phead->next = new; //append process to an existing container
+				}
+				break;
+			}
+			t = temp;
+			temp = temp->next;
+		}
+		if(temp==NULL) //creating a new container and appending it to container list
+		{
+			container_list *new = (container_list *)kmalloc(sizeof(container_list), GFP_KERNEL);
+			initcontainer(new, container_id);
+			process_list *phead = newprocess(new);
+			new->list = phead;
+			t->next = new;
+		}
+	}
+
+	
+	//printk("\nExiting create");
+	print_container();
+	mutex_unlock(&mutex);
+	return 0;
+}
+
+
+int memory_container_free(struct memory_container_cmd __user *user_cmd)
+{
+	mutex_lock(&mutex);
+	struct memory_container_cmd c;
+	copy_from_user(&c,user_cmd, sizeof(c)); //fetch container Id from user space
+	unsigned long object_id = (int)c.oid;
+	container_list *container = findcontainer(current);
+	//printk("\nEntering free for process %d, container %d and object %d", current->pid, container->cid, object_id);
+	object_list *current_object = findobject(object_id, container);
+
+	//tasks that still map the object keep its memory until they unmap it
+	if(current_object != NULL)
+		dropobject(current_object, container);
+	//printk("\nExiting free");
+	print_container();	
+	mutex_unlock(&mutex);
+	return 0;
+}
+
+
+/**
+ * Waiter of memory_container_wait(), only woken by wakes naming its word.
+ */
+typedef struct word_wait
+{
+	wait_queue_t wait;
+	u64 oid;
+	u64 offset;
+}word_wait;
+
+
+/***wakeword() wakes the waiter if the wake in key names its word or its whole object***/
+static int wakeword(wait_queue_t *wait, unsigned mode, int sync, void *key)
+{
+	word_wait *w = container_of(wait, word_wait, wait);
+	struct memory_container_wait_cmd *c = key;
+
+	if(w->oid != c->oid || (c->offset != MCONTAINER_WAKE_OBJECT && w->offset != c->offset))
+		return 0;
+	return autoremove_wake_function(wait, mode, sync, NULL);
+}
+
+
+/**
+ * Sleep until the word at c.offset in object c.oid differs from c.value or a
+ * wake is issued on that word. The word is checked with the global mutex
+ * held and wakers take it too, so a wake between the check and the sleep is
+ * never lost.
+ */
+int memory_container_wait(struct memory_container_wait_cmd __user *user_cmd)
+{
+	container_list *container;
+	object_list *o;
+	struct memory_container_wait_cmd c;
+	word_wait w;
+	int ret = 0;
+
+	if(copy_from_user(&c, user_cmd, sizeof(c)))
+		return -EFAULT;
+	if(c.offset & 3)
+		return -EINVAL;
+	init_wait(&w.wait);
+	w.wait.func = wakeword;
+	w.oid = c.oid;
+	w.offset = c.offset;
+
+	mutex_lock(&mutex);
+	container = findcontainer(current);
+	o = container == NULL ? NULL : findobject(c.oid, container);
+	if(o == NULL || c.offset >= o->data->size || sizeof(u32) > o->data->size - c.offset)
+		ret = -EINVAL;
+	else
+		ret = residentobject(o, container);
+	if(ret)
+	{
+		mutex_unlock(&mutex);
+		return ret;
+	}
+	prepare_to_wait(&container->wq, &w.wait, TASK_INTERRUPTIBLE);
+	if(READ_ONCE(*(u32 *)(o->data->virt_addr + c.offset)) != (u32)c.value)
+	{
+		finish_wait(&container->wq, &w.wait);
+		mutex_unlock(&mutex);
+		return 0;
+	}
+	mutex_unlock(&mutex);
+	schedule();
+	finish_wait(&container->wq, &w.wait);
+	if(signal_pending(current))
+		ret = -ERESTARTSYS;
+	return ret; //callers re-check their condition, wakeups may be spurious
+}
+
+
+/**
+ * Wake the members of the caller's container sleeping in
+ * memory_container_wait() on the word at c.offset of object c.oid, or on
+ * any word of it when c.offset is MCONTAINER_WAKE_OBJECT, and report a
+ * write of the object to the files watching it.
+ */
+int memory_container_wake(struct memory_container_wait_cmd __user *user_cmd)
+{
+	container_list *container;
+	struct memory_container_wait_cmd c;
+
+	if(copy_from_user(&c, user_cmd, sizeof(c)))
+		return -EFAULT;
+
+	mutex_lock(&mutex);
+	container = findcontainer(current);
+	if(container != NULL)
+	{
+		__wake_up(&container->wq, TASK_INTERRUPTIBLE, 0, &c);
+		notifywatchers(container, c.oid, MCONTAINER_WATCH_WRITE);
+	}
+	mutex_unlock(&mutex);
+	return container == NULL ? -EINVAL : 0;
+}
+
+
+/**
+ * Turn the caller's container into a cache of at most c.size bytes of
+ * objects, evicting unmapped and unlocked ones in c.op order
+ * (MCONTAINER_EVICT_CLOCK or MCONTAINER_EVICT_LRU). A size of 0 turns
+ * eviction off again.
+ */
+int memory_container_cache(struct memory_container_cmd __user *user_cmd)
+{
+	container_list *container;
+	struct memory_container_cmd c;
+	int ret = 0;
+
+	if(copy_from_user(&c, user_cmd, sizeof(c)))
+		return -EFAULT;
+	if(c.op != MCONTAINER_EVICT_CLOCK && c.op != MCONTAINER_EVICT_LRU)
+		return -EINVAL;
+
+	mutex_lock(&mutex);
+	container = findcontainer(current);
+	if(container == NULL)
+		ret = -EINVAL;
+	else
+	{
+		container->cache_policy = c.op;
+		container->cache_budget = c.size;
+		makeroom(0, container); //shrinking the budget evicts what it can right away
+	}
+	mutex_unlock(&mutex);
+	return ret;
+}
+
+
+/**
+ * Copy the counters of the caller's container to user space.
+ */
+int memory_container_stats(struct memory_container_stats __user *user_stats)
+{
+	container_list *container;
+	process_list *process;
+	object_list *o;
+	struct memory_container_stats st;
+
+	memset(&st, 0, sizeof(st));
+	mutex_lock(&mutex);
+	container = findcontainer(current);
+	if(container == NULL)
+	{
+		mutex_unlock(&mutex);
+		return -EINVAL;
+	}
+	process = findprocess(current, container);
+	st.hits = container->hits;
+	st.misses = container->misses;
+	st.evictions = container->evictions;
+	st.bytes = container->cache_bytes;
+	st.budget = container->cache_budget;
+	st.last_miss = process->last_miss;
+	for(o = container->olist; o != NULL; o = o->next)
+	{
+		if(o->data->hashed) //merged memory is charged evenly to the objects sharing it
+			st.dedup_saved += o->data->size - o->data->size / o->data->refs;
+		else if(o->data->zdata != NULL)
+		{
+			st.zbytes += o->data->size;
+			st.zstored += o->data->zsize;
+		}
+	}
+	st.inflates = container->inflates;
+	st.inflate_ns = container->inflate_ns;
+	mutex_unlock(&mutex);
+
+	if(copy_to_user(user_stats, &st, sizeof(st)))
+		return -EFAULT;
+	return 0;
+}
+
+
+/***findkey() looks a key up; the caller holds rcu_read_lock() or keys_lock***/
+static key_entry* findkey(const char *key, u32 hash, container_list *container)
+{
+	key_entry *k;
+
+	hash_for_each_possible_rcu(container->keys, k, node, hash)
+	{
+		if(k->hash == hash && strcmp(k->key, key) == 0)
+			return k;
+	}
+	return NULL;
+}
+
+
+/***fetchkey() copies a key command from user space and hashes its key***/
+static int fetchkey(struct memory_container_key_cmd *c, struct memory_container_key_cmd __user *user_cmd, u32 *hash)
+{
+	if(copy_from_user(c, user_cmd, sizeof(*c)))
+		return -EFAULT;
+	c->key[MCONTAINER_KEY_MAX - 1] = '\0';
+	*hash = jhash(c->key, strlen(c->key), 0);
+	return 0;
+}
+
+
+/**
+ * Bind c.key to object c.oid of c.size bytes, replacing any previous binding.
+ */
+int memory_container_put(struct memory_container_key_cmd __user *user_cmd)
+{
+	container_list *container;
+	struct memory_container_key_cmd c;
+	key_entry *new, *old;
+	u32 hash;
+	int ret;
+
+	if((ret = fetchkey(&c, user_cmd, &hash)))
+		return ret;
+	if(c.size == 0 || c.oid >= MCONTAINER_ARENA_PGOFF) //those offsets map the arena, not an object
+		return -EINVAL;
+	if((container = findcontainer(current)) == NULL)
+		return -EINVAL;
+
+	new = (key_entry *)kmalloc(sizeof(key_entry), GFP_KERNEL);
+	if(new == NULL)
+		return -ENOMEM;
+	new->hash = hash;
+	new->oid = c.oid;
+	new->size = PAGE_ALIGN(c.size);
+	strcpy(new->key, c.key);
+
+	spin_lock(&container->keys_lock);
+	old = findkey(c.key, hash, container);
+	if(old != NULL)
+		hash_del_rcu(&old->node);
+	hash_add_rcu(container->keys, &new->node, hash);
+	spin_unlock(&container->keys_lock);
+	if(old != NULL)
+		kfree_rcu(old, rcu);
+	return 0;
+}
+
+
+/**
+ * Resolve c.key and map its object into the caller in the same call; the
+ * address, oid and size come back in c.
+ */
+int memory_container_get(struct file *filp, struct memory_container_key_cmd __user *user_cmd)
+{
+	container_list *container;
+	struct memory_container_key_cmd c;
+	key_entry *k;
+	unsigned long addr;
+	u32 hash;
+	int ret;
+
+	if((ret = fetchkey(&c, user_cmd, &hash)))
+		return ret;
+	if((container = findcontainer(current)) == NULL)
+		return -EINVAL;
+
+	rcu_read_lock();
+	k = findkey(c.key, hash, container);
+	if(k != NULL)
+	{
+		c.oid = k->oid;
+		c.size = k->size;
+	}
+	rcu_read_unlock();
+	if(k == NULL)
+		return -ENOENT;
+
+	addr = vm_mmap(filp, 0, c.size, PROT_READ | PROT_WRITE, MAP_SHARED, c.oid << PAGE_SHIFT);
+	if(IS_ERR_VALUE(addr))
+		return (int)addr;
+	c.addr = addr;
+	if(copy_to_user(user_cmd, &c, sizeof(c)))
+		return -EFAULT;
+	return 0;
+}
+
+
+/**
+ * Remove the binding of c.key and free the object it named.
+ */
+int memory_container_del(struct memory_container_key_cmd __user *user_cmd)
+{
+	container_list *container;
+	struct memory_container_key_cmd c;
+	object_list *o;
+	key_entry *k;
+	u32 hash;
+	int ret;
+
+	if((ret = fetchkey(&c, user_cmd, &hash)))
+		return ret;
+	if((container = findcontainer(current)) == NULL)
+		return -EINVAL;
+
+	spin_lock(&container->keys_lock);
+	k = findkey(c.key, hash, container);
+	if(k != NULL)
+		hash_del_rcu(&k->node);
+	spin_unlock(&container->keys_lock);
+	if(k == NULL)
+		return -ENOENT;
+
+	mutex_lock(&mutex);
+	o = findobject(k->oid, container);
+	if(o != NULL)
+		dropobject(o, container);
+	mutex_unlock(&mutex);
+	kfree_rcu(k, rcu);
+	return 0;
+}
+
+
+/**
+ * Compare-and-swap the 64-bit word at c.offset of object c.oid. With a
+ * version other than MCONTAINER_ANY_VERSION the swap also requires the
+ * object to still be at that version. On return c.expected holds the value
+ * the word had and c.version the object's version; -EAGAIN means the
+ * update was not applied.
+ */
+int memory_container_cas(struct memory_container_cas_cmd __user *user_cmd)
+{
+	container_list *container;
+	object_list *o;
+	struct memory_container_cas_cmd c;
+	u64 old;
+	int ret = 0;
+
+	if(copy_from_user(&c, user_cmd, sizeof(c)))
+		return -EFAULT;
+	if(c.offset & 7)
+		return -EINVAL;
+
+	mutex_lock(&mutex);
+	container = findcontainer(current);
+	o = container == NULL ? NULL : findobject(c.oid, container);
+	if(o == NULL || c.offset >= o->data->size || sizeof(u64) > o->data->size - c.offset)
+		ret = -EINVAL;
+	else if(o->data->readonly)
+		ret = -EPERM;
+	else if(residentobject(o, container) || unshareobject(o))
+		ret = -ENOMEM;
+	else
+	{
+		//members may update the word through their mappings too, so swap atomically
+		old = cmpxchg64((u64 *)(o->data->virt_addr + c.offset), c.expected,
+			(c.version == MCONTAINER_ANY_VERSION || c.version == o->version) ? c.desired : c.expected);
+		if(old != c.expected || (c.version != MCONTAINER_ANY_VERSION && c.version != o->version))
+			ret = -EAGAIN;
+		else
+		{
+			o->version++;
+			notifywatchers(container, c.oid, MCONTAINER_WATCH_WRITE);
+		}
+		c.expected = old;
+		c.version = o->version;
+	}
+	mutex_unlock(&mutex);
+
+	if(ret == 0 || ret == -EAGAIN)
+		if(copy_to_user(user_cmd, &c, sizeof(c)))
+			return -EFAULT;
+	return ret;
+}
+
+
+/**
+ * Copy c.size bytes from c.buf to c.offset of object c.oid if the object is
+ * still at c.version (or unconditionally with MCONTAINER_ANY_VERSION). The
+ * resulting version is returned in c.version.
+ */
+int memory_container_cwrite(struct memory_container_cas_cmd __user *user_cmd)
+{
+	container_list *container;
+	object_list *o;
+	struct memory_container_cas_cmd c;
+	char *data;
+	int ret = 0;
+
+	if(copy_from_user(&c, user_cmd, sizeof(c)))
+		return -EFAULT;
+	if(c.size == 0 || c.size > MCONTAINER_CWRITE_MAX)
+		return -EINVAL;
+	//stage the data first, copy_from_user may fault and must not run under the mutex
+	data = kmalloc(c.size, GFP_KERNEL);
+	if(data == NULL)
+		return -ENOMEM;
+	if(copy_from_user(data, (void __user *)(unsigned long)c.buf, c.size))
+	{
+		kfree(data);
+		return -EFAULT;
+	}
+
+	mutex_lock(&mutex);
+	container = findcontainer(current);
+	o = container == NULL ? NULL : findobject(c.oid, container);
+	if(o == NULL || c.offset >= o->data->size || c.size > o->data->size - c.offset)
+		ret = -EINVAL;
+	else if(o->data->readonly)
+		ret = -EPERM;
+	else if(c.version != MCONTAINER_ANY_VERSION && c.version != o->version)
+		ret = -EAGAIN;
+	else if(residentobject(o, container) || unshareobject(o))
+		ret = -ENOMEM;
+	else
+	{
+		memcpy(o->data->virt_addr + c.offset, data, c.size);
+		o->version++;
+		notifywatchers(container, c.oid, MCONTAINER_WATCH_WRITE);
+	}
+	if(o != NULL)
+		c.version = o->version;
+	mutex_unlock(&mutex);
+	kfree(data);
+
+	if(ret == 0 || ret == -EAGAIN)
+		if(copy_to_user(user_cmd, &c, sizeof(c)))
+			return -EFAULT;
+	return ret;
+}
+
+
+/***findpublished() looks up published memory by name***/
+static object_data* findpublished(u64 name)
+{
+	object_data *d;
+
+	for(d = published; d != NULL; d = d->next)
+		if(d->name == name)
+			return d;
+	return NULL;
+}
+
+
+/**
+ * Freeze object c.oid of the caller's container read-only and publish its
+ * memory under c.name for other containers to attach. Nobody may still map
+ * the object writable.
+ */
+int memory_container_publish(struct memory_container_publish_cmd __user *user_cmd)
+{
+	container_list *container;
+	object_list *o;
+	struct memory_container_publish_cmd c;
+	int ret = 0;
+
+	if(copy_from_user(&c, user_cmd, sizeof(c)))
+		return -EFAULT;
+
+	mutex_lock(&mutex);
+	container = findcontainer(current);
+	o = container == NULL ? NULL : findobject(c.oid, container);
+	if(o == NULL)
+		ret = -ENOENT;
+	else if(findpublished(c.name) != NULL)
+		ret = -EEXIST;
+	else if(o->wrefs > 0 || o->data->readonly)
+		ret = -EBUSY;
+	else if(residentobject(o, container) || unshareobject(o)) //the other objects merged with it stay writable
+		ret = -ENOMEM;
+	else
+	{
+		o->data->readonly = 1;
+		o->data->name = c.name;
+		o->data->next = published;
+		published = o->data;
+		c.size = o->data->size;
+	}
+	mutex_unlock(&mutex);
+
+	if(ret == 0 && copy_to_user(user_cmd, &c, sizeof(c)))
+		return -EFAULT;
+	return ret;
+}
+
+
+/**
+ * Make the memory published under c.name object c.oid of the caller's
+ * container. The pages are shared, not copied; c.size returns their size.
+ */
+int memory_container_attach(struct memory_container_publish_cmd __user *user_cmd)
+{
+	container_list *container;
+	object_data *d;
+	struct memory_container_publish_cmd c;
+	int ret = 0;
+
+	if(copy_from_user(&c, user_cmd, sizeof(c)))
+		return -EFAULT;
+
+	mutex_lock(&mutex);
+	container = findcontainer(current);
+	d = findpublished(c.name);
+	if(container == NULL || d == NULL)
+		ret = -ENOENT;
+	else if(findobject(c.oid, container) != NULL)
+		ret = -EEXIST;
+	else if(makeroom(d->size, container))
+		ret = -ENOMEM;
+	else
+	{
+		d->refs++;
+		if(linkobject(c.oid, d, container) == NULL) //drops our reference on failure
+			ret = -ENOMEM;
+		c.size = d->size;
+	}
+	mutex_unlock(&mutex);
+
+	if(ret == 0 && copy_to_user(user_cmd, &c, sizeof(c)))
+		return -EFAULT;
+	return ret;
+}
+
+
+/***dedupable() tells whether the memory of an object may be hashed and merged: unmapped, unshared and not hashed yet***/
+static int dedupable(object_list *o)
+{
+	object_data *d = o->data;
+
+	return o->refs == 0 && d->refs == 1 && !d->hashed && !d->readonly && d->virt_addr != NULL && d->pins == 0;
+}
+
+
+/***dedupnext() finds an object of an opted in container the scanner has yet to hash***/
+static object_list* dedupnext(void)
+{
+	container_list *container;
+	object_list *o;
+
+	for(container = head; container != NULL; container = container->next)
+	{
+		if(!container->dedup)
+			continue;
+		for(o = container->olist; o != NULL; o = o->next)
+			if(dedupable(o))
+				return o;
+	}
+	return NULL;
+}
+
+
+/***dataowner() finds the object still backed by unshared memory d, if any***/
+static object_list* dataowner(object_data *d)
+{
+	container_list *container;
+	object_list *o;
+
+	for(container = head; container != NULL; container = container->next)
+		for(o = container->olist; o != NULL; o = o->next)
+			if(o->data == d)
+				return o;
+	return NULL;
+}
+
+
+/***dedupmatch() finds hashed memory that may have the same contents as d***/
+static object_data* dedupmatch(object_data *d)
+{
+	object_data *m;
+
+	hash_for_each_possible(dedup_table, m, dnode, d->hash)
+	{
+		if(m->hash == d->hash && m->size == d->size)
+			return m;
+	}
+	return NULL;
+}
+
+
+/**
+ * One pass of the dedup scanner. Only unmapped objects are hashed since
+ * nobody can write them behind our back; an object whose contents match
+ * memory already in the table is switched over to it and its own memory
+ * freed. Merged memory is copied again by unshareobject() before it is
+ * mapped or written, so no mapping is left on memory an object moved off.
+ * Hashing and comparing run without the mutex on pinned memory, so a large
+ * object does not stall the containers; whatever was written meanwhile is
+ * left for a later pass.
+ */
+static void dedup_scan(struct work_struct *work)
+{
+	object_list *o;
+	object_data *d, *m;
+	unsigned long writes, mwrites = 0;
+	unsigned int budget;
+	u32 hash;
+	int same = 0;
+
+	for(budget = dedup_rate; budget > 0; budget--)
+	{
+		mutex_lock(&mutex);
+		o = dedupnext();
+		if(o == NULL)
+		{
+			mutex_unlock(&mutex);
+			break;
 		}
-		prev_object = objectHead;
-		objectHead = objectHead->next;
+		d = o->data;
+		d->pins++;
+		writes = d->writes;
+		mutex_unlock(&mutex);
+
+		hash = jhash(d->virt_addr, d->size, 0);
+
+		mutex_lock(&mutex);
+		m = NULL;
+		if(d->writes == writes)
+		{
+			d->hash = hash;
+			m = dedupmatch(d);
+			if(m != NULL)
+			{
+				m->pins++;
+				mwrites = m->writes;
+			}
+		}
+		mutex_unlock(&mutex);
+
+		if(m != NULL)
+			same = memcmp(m->virt_addr, d->virt_addr, d->size) == 0;
+
+		mutex_lock(&mutex);
+		o = dataowner(d);
+		if(o != NULL && d->writes == writes && o->refs == 0 && !d->hashed && !d->readonly)
+		{
+			if(m != NULL && same && m->hashed && m->writes == mwrites)
+			{
+				m->refs++;
+				o->data = m;
+				putdata(d);
+			}
+			else if(m == NULL || !same) //a collision is hashed as well, only the first match is ever compared
+			{
+				hash_add(dedup_table, &d->dnode, d->hash);
+				d->hashed = 1;
+			}
+		}
+		if(m != NULL)
+			unpindata(m);
+		unpindata(d);
+		mutex_unlock(&mutex);
 	}
-	//printk("\nExiting free");
-	print_container();	
+	mutex_lock(&mutex);
+	if(dedup_containers > 0)
+		schedule_delayed_work(&dedup_work, msecs_to_jiffies(dedup_interval));
+	mutex_unlock(&mutex);
+}
+
+
+/**
+ * Opt the caller's container in to (c.op non-zero) or out of the dedup
+ * scanner. Objects already merged stay shared until they are mapped or
+ * written.
+ */
+int memory_container_dedup(struct memory_container_cmd __user *user_cmd)
+{
+	container_list *container;
+	struct memory_container_cmd c;
+	int ret = 0;
+
+	if(copy_from_user(&c, user_cmd, sizeof(c)))
+		return -EFAULT;
+
+	mutex_lock(&mutex);
+	container = findcontainer(current);
+	if(container == NULL)
+		ret = -EINVAL;
+	else if(!container->dedup != !c.op)
+	{
+		container->dedup = !!c.op;
+		dedup_containers += container->dedup ? 1 : -1;
+		if(dedup_containers == 1 && container->dedup)
+			schedule_delayed_work(&dedup_work, 0);
+	}
+	mutex_unlock(&mutex);
+	return ret;
+}
+
+
+/***compressnext() finds an object that went cold: unmapped, backing no other object and unused for its container's cold interval***/
+static object_list* compressnext(void)
+{
+	container_list *container;
+	object_list *o;
+	object_data *d;
+
+	for(container = head; container != NULL; container = container->next)
+	{
+		if(container->cold_ms == 0)
+			continue;
+		for(o = container->olist; o != NULL; o = o->next)
+		{
+			d = o->data;
+			if(o->refs > 0 || d->refs > 1 || d->readonly || d->virt_addr == NULL || d->pins > 0)
+				continue;
+			if(time_before(jiffies, o->last_used + msecs_to_jiffies(container->cold_ms)))
+				continue;
+			return o;
+		}
+	}
+	return NULL;
+}
+
+
+/**
+ * One pass of the compressor over the containers with a cold interval. Only
+ * objects that are unmapped and back no other object are compressed, so
+ * every access that can reach their memory goes through residentobject().
+ * The memory is compressed without the mutex while pinned; the compressed
+ * copy only replaces it if nothing wrote, mapped or dropped it meanwhile.
+ */
+static void compress_scan(struct work_struct *work)
+{
+	object_list *o;
+	object_data *d;
+	unsigned char *z;
+	unsigned long writes;
+	unsigned int budget;
+	size_t zsize;
+	int ret;
+
+	for(budget = compress_rate; budget > 0; budget--)
+	{
+		mutex_lock(&mutex);
+		o = compressnext();
+		if(o == NULL)
+		{
+			mutex_unlock(&mutex);
+			break;
+		}
+		d = o->data;
+		d->pins++;
+		writes = d->writes;
+		o->last_used = jiffies; //objects that do not compress are retried a cold interval later
+		mutex_unlock(&mutex);
+
+		ret = deflatedata(d, &z, &zsize);
+
+		mutex_lock(&mutex);
+		o = dataowner(d);
+		//the dedup scanner may be comparing against it too
+		if(z != NULL && o != NULL && o->refs == 0 && d->refs == 1 && d->pins == 1 && d->writes == writes)
+		{
+			unhashdata(d);
+			kfree(d->virt_addr);
+			d->virt_addr = NULL;
+			d->pfn = 0;
+			d->zdata = z;
+			d->zsize = zsize;
+			z = NULL;
+		}
+		unpindata(d);
+		mutex_unlock(&mutex);
+		vfree(z);
+		if(ret)
+			break; //out of memory, try again next pass
+	}
+	mutex_lock(&mutex);
+	if(compress_containers > 0)
+		schedule_delayed_work(&compress_work, msecs_to_jiffies(compress_interval));
+	mutex_unlock(&mutex);
+}
+
+
+/**
+ * Compress objects of the caller's container once nobody mapped or touched
+ * them for c.size milliseconds; 0 stops compressing. Compressed objects are
+ * decompressed by their next mmap, fault or ioctl access.
+ */
+int memory_container_compress(struct memory_container_cmd __user *user_cmd)
+{
+	container_list *container;
+	struct memory_container_cmd c;
+	int ret = 0;
+
+	if(copy_from_user(&c, user_cmd, sizeof(c)))
+		return -EFAULT;
+
+	mutex_lock(&mutex);
+	container = findcontainer(current);
+	if(container == NULL)
+		ret = -EINVAL;
+	else
+	{
+		if(!container->cold_ms != !c.size)
+			compress_containers += c.size ? 1 : -1;
+		container->cold_ms = c.size;
+		if(compress_containers == 1 && c.size)
+			schedule_delayed_work(&compress_work, msecs_to_jiffies(compress_interval));
+	}
+	mutex_unlock(&mutex);
+	return ret;
+}
+
+
+/**
+ * Apply access hint c.op to the objects [c.oid, c.oid + c.size) of the
+ * caller's container (just c.oid if size is 0). WILLNEED brings them into
+ * memory, creating missing arena objects, and with a non-zero c.addr also
+ * populates the caller's arena window there. DONTNEED releases the memory
+ * of unmapped objects but keeps them; they read as zeroes when used again.
+ * SEQUENTIAL reads the next object ahead on every access and lets accessed
+ * ones be evicted first; NORMAL and RANDOM turn that off again.
+ */
+int memory_container_advise(struct memory_container_cmd __user *user_cmd)
+{
+	container_list *container;
+	object_list *o, **objects = NULL;
+	struct memory_container_cmd c;
+	unsigned long *seen = NULL, end, span = 0, bit, count, n = 0, i;
+	int ret = 0;
+
+	if(copy_from_user(&c, user_cmd, sizeof(c)))
+		return -EFAULT;
+	if(c.op > MCONTAINER_ADV_DONTNEED)
+		return -EINVAL;
+	count = c.size ? c.size : 1;
+	end = c.oid + count < c.oid ? ULONG_MAX : c.oid + count;
+
+	mutex_lock(&mutex);
+	container = findcontainer(current);
+	if(container == NULL)
+	{
+		mutex_unlock(&mutex);
+		return -EINVAL;
+	}
+	//missing arena objects are created first, so whatever they evict is not touched below
+	if(c.op == MCONTAINER_ADV_WILLNEED && c.oid < container->arena_objects)
+	{
+		span = min(end, container->arena_objects) - c.oid;
+		seen = (unsigned long *)vzalloc(BITS_TO_LONGS(span) * sizeof(unsigned long));
+		if(seen == NULL)
+			ret = -ENOMEM;
+		for(o = container->olist; o != NULL && ret == 0; o = o->next)
+			if(o->oid >= c.oid && o->oid - c.oid < span)
+				__set_bit(o->oid - c.oid, seen);
+		if(ret == 0)
+		{
+			for_each_clear_bit(bit, seen, span)
+			{
+				if(allocobject(c.oid + bit, container->arena_size, container) == NULL)
+				{
+					ret = -ENOMEM;
+					break;
+				}
+			}
+		}
+		vfree(seen);
+	}
+	//one walk over the objects instead of a lookup per id of a possibly huge range
+	for(o = container->olist; o != NULL && ret == 0; o = o->next)
+		if(o->oid >= c.oid && o->oid < end)
+			n++;
+	if(ret == 0 && n > 0)
+	{
+		objects = (object_list **)kmalloc_array(n, sizeof(object_list *), GFP_KERNEL);
+		if(objects == NULL)
+			ret = -ENOMEM;
+		i = 0;
+		for(o = container->olist; o != NULL && ret == 0; o = o->next)
+			if(o->oid >= c.oid && o->oid < end)
+				objects[i++] = o;
+	}
+	for(i = 0; i < n && ret == 0; i++)
+	{
+		o = objects[i];
+		switch(c.op)
+		{
+		case MCONTAINER_ADV_WILLNEED:
+			touchobject(o, container);
+			ret = residentobject(o, container);
+			break;
+		case MCONTAINER_ADV_DONTNEED:
+			//mapped objects keep their pages, and published memory is never given up
+			if(o->refs == 0 && !o->data->readonly)
+				ret = dropdata(o);
+			break;
+		default:
+			o->advice = c.op;
+		}
+	}
+	kfree(objects);
+	mutex_unlock(&mutex);
+
+	if(ret == 0 && c.op == MCONTAINER_ADV_WILLNEED && c.addr)
+		ret = prefaultwindow(c.addr, c.oid, count);
+	return ret;
+}
+
+
+/***unlinkwatch() takes a subscription off its container and forgets what it watched***/
+static void unlinkwatch(watch_list *w)
+{
+	watch_list **p;
+
+	if(w->container != NULL)
+	{
+		for(p = &w->container->wlist; *p != NULL; p = &(*p)->next)
+		{
+			if(*p == w)
+			{
+				*p = w->next;
+				break;
+			}
+		}
+	}
+	w->container = NULL;
+	kfree(w->oids);
+	kfree(w->pending);
+	if(w->eventfd != NULL)
+		eventfd_ctx_put(w->eventfd);
+	w->oids = NULL;
+	w->pending = NULL;
+	w->count = 0;
+	w->npending = 0;
+	w->eventfd = NULL;
+}
+
+
+/**
+ * Subscribe filp to changes of the c.count objects listed at c.oids, replacing
+ * what it watched before. The subscription stays with the file and is
+ * dropped by a count of 0 or by closing it.
+ */
+int memory_container_watch(struct file *filp, struct memory_container_watch_cmd __user *user_cmd)
+{
+	container_list *container;
+	struct memory_container_watch_cmd c;
+	watch_list *w, *fresh = NULL;
+	struct eventfd_ctx *eventfd = NULL;
+	unsigned long *pending = NULL;
+	u64 *oids = NULL;
+	unsigned long i, n = 0;
+	int ret = 0;
+
+	if(copy_from_user(&c, user_cmd, sizeof(c)))
+		return -EFAULT;
+	if(c.count > MCONTAINER_WATCH_MAX)
+		return -EINVAL;
+	if(c.count)
+	{
+		oids = (u64 *)kmalloc_array(c.count, sizeof(u64), GFP_KERNEL);
+		pending = (unsigned long *)kcalloc(BITS_TO_LONGS(c.count), sizeof(unsigned long), GFP_KERNEL);
+		if(oids == NULL || pending == NULL)
+			ret = -ENOMEM;
+		else if(copy_from_user(oids, (void __user *)(unsigned long)c.oids, c.count * sizeof(u64)))
+			ret = -EFAULT;
+		else
+		{
+			sort(oids, c.count, sizeof(u64), cmpoid, NULL);
+			for(i = 0; i < c.count; i++) //drop duplicates
+				if(n == 0 || oids[i] != oids[n - 1])
+					oids[n++] = oids[i];
+		}
+		if(ret == 0 && c.eventfd >= 0)
+		{
+			eventfd = eventfd_ctx_fdget(c.eventfd);
+			if(IS_ERR(eventfd))
+			{
+				ret = PTR_ERR(eventfd);
+				eventfd = NULL;
+			}
+		}
+		//only installed if the file still has none once we hold the mutex
+		if(ret == 0 && filp->private_data == NULL)
+		{
+			fresh = (watch_list *)kzalloc(sizeof(watch_list), GFP_KERNEL);
+			if(fresh == NULL)
+				ret = -ENOMEM;
+			else
+				init_waitqueue_head(&fresh->wq);
+		}
+	}
+
+	mutex_lock(&mutex);
+	container = findcontainer(current);
+	if(ret == 0 && container == NULL)
+		ret = -EINVAL;
+	//once installed the watch_list lives until release, another thread may be sleeping on its wq
+	w = filp->private_data;
+	if(ret == 0 && w == NULL && fresh != NULL)
+	{
+		w = fresh;
+		fresh = NULL;
+		filp->private_data = w;
+	}
+	if(ret == 0)
+	{
+		if(w != NULL)
+			unlinkwatch(w);
+		if(c.count)
+		{
+			w->container = container;
+			w->oids = oids;
+			w->count = n;
+			w->pending = pending;
+			w->events = c.events;
+			w->eventfd = eventfd;
+			w->next = container->wlist;
+			container->wlist = w;
+			oids = NULL;
+			pending = NULL;
+			eventfd = NULL;
+		}
+	}
+	mutex_unlock(&mutex);
+
+	kfree(fresh);
+	kfree(oids);
+	kfree(pending);
+	if(eventfd != NULL)
+		eventfd_ctx_put(eventfd);
+	return ret;
+}
+
+
+int memory_container_open(struct inode *inode, struct file *filp)
+{
+	filp->private_data = NULL; //misc_open() leaves the miscdevice here
+	return 0;
+}
+
+
+/**
+ * Called on every close of the device. When it comes from a process going
+ * away, its tasks leave their containers and hand on the locks they held,
+ * whether or not they called memory_container_delete().
+ */
+int memory_container_flush(struct file *filp, fl_owner_t id)
+{
+	mutex_lock(&mutex);
+	prunetasks(!!(current->flags & PF_EXITING));
+	mutex_unlock(&mutex);
+	return 0;
+}
+
+
+int memory_container_release(struct inode *inode, struct file *filp)
+{
+	watch_list *w = filp->private_data;
+
+	mutex_lock(&mutex);
+	if(w != NULL)
+		unlinkwatch(w);
+	prunetasks(0);
 	mutex_unlock(&mutex);
+	kfree(w);
 	return 0;
 }
 
 
+unsigned int memory_container_poll(struct file *filp, poll_table *wait)
+{
+	watch_list *w = filp->private_data;
+
+	if(w == NULL)
+		return POLLERR;
+	poll_wait(filp, &w->wq, wait);
+	return READ_ONCE(w->npending) ? POLLIN | POLLRDNORM : 0;
+}
+
+
+/**
+ * Return the oids that changed since the last read as an array of __u64,
+ * sleeping until one does unless the file is non-blocking.
+ */
+ssize_t memory_container_read(struct file *filp, char __user *buf, size_t len, loff_t *ppos)
+{
+	watch_list *w = filp->private_data;
+	size_t n = 0, max = min_t(size_t, len / sizeof(u64), MCONTAINER_WATCH_MAX);
+	unsigned long bit;
+	ssize_t ret;
+	u64 *out;
+
+	if(w == NULL || max == 0)
+		return -EINVAL;
+	out = (u64 *)kmalloc_array(max, sizeof(u64), GFP_KERNEL);
+	if(out == NULL)
+		return -ENOMEM;
+	for(;;)
+	{
+		mutex_lock(&mutex);
+		for_each_set_bit(bit, w->pending, w->count)
+		{
+			if(n == max)
+				break;
+			out[n++] = w->oids[bit];
+			__clear_bit(bit, w->pending);
+			w->npending--;
+		}
+		mutex_unlock(&mutex);
+		if(n > 0 || (filp->f_flags & O_NONBLOCK))
+			break;
+		if(wait_event_interruptible(w->wq, READ_ONCE(w->npending) > 0))
+		{
+			kfree(out);
+			return -ERESTARTSYS;
+		}
+	}
+	if(n == 0)
+		ret = -EAGAIN;
+	else if(copy_to_user(buf, out, n * sizeof(u64)))
+		ret = -EFAULT;
+	else
+		ret = n * sizeof(u64);
+	kfree(out);
+	return ret;
+}
+
+
 /**
  * control function that receive the command in user space and pass arguments to
  * corresponding functions.
@@ -459,6 +2707,40 @@ int memory_container_ioctl(struct file *filp, unsigned int cmd, unsigned long ar
         return memory_container_unlock((void __user *)arg);
     case MCONTAINER_IOCTL_FREE:
         return memory_container_free((void __user *)arg);
+    case MCONTAINER_IOCTL_ARENA:
+        return memory_container_arena((void __user *)arg);
+    case MCONTAINER_IOCTL_PREFAULT:
+        return memory_container_prefault((void __user *)arg);
+    case MCONTAINER_IOCTL_WAIT:
+        return memory_container_wait((void __user *)arg);
+    case MCONTAINER_IOCTL_WAKE:
+        return memory_container_wake((void __user *)arg);
+    case MCONTAINER_IOCTL_CACHE:
+        return memory_container_cache((void __user *)arg);
+    case MCONTAINER_IOCTL_STATS:
+        return memory_container_stats((void __user *)arg);
+    case MCONTAINER_IOCTL_PUT:
+        return memory_container_put((void __user *)arg);
+    case MCONTAINER_IOCTL_GET:
+        return memory_container_get(filp, (void __user *)arg);
+    case MCONTAINER_IOCTL_DEL:
+        return memory_container_del((void __user *)arg);
+    case MCONTAINER_IOCTL_CAS:
+        return memory_container_cas((void __user *)arg);
+    case MCONTAINER_IOCTL_CWRITE:
+        return memory_container_cwrite((void __user *)arg);
+    case MCONTAINER_IOCTL_PUBLISH:
+        return memory_container_publish((void __user *)arg);
+    case MCONTAINER_IOCTL_ATTACH:
+        return memory_container_attach((void __user *)arg);
+    case MCONTAINER_IOCTL_DEDUP:
+        return memory_container_dedup((void __user *)arg);
+    case MCONTAINER_IOCTL_COMPRESS:
+        return memory_container_compress((void __user *)arg);
+    case MCONTAINER_IOCTL_ADVISE:
+        return memory_container_advise((void __user *)arg);
+    case MCONTAINER_IOCTL_WATCH:
+        return memory_container_watch(filp, (void __user *)arg);
     default:
         return -ENOTTY;
     }
@@ -0,0 +1,352 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+//
+//
+//                             Copyright 2016
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Author:  Hung-Wei Tseng, Yu-Chia Liu
+//
+//   Description:
+//     Shared Heap over a Memory Container Object
+//
+////////////////////////////////////////////////////////////////////////
+
+#include "mcontainer.h"
+
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+
+#define HEAP_MAGIC 0x6d636870
+#define HEAP_FREE 0x6d636866
+#define HEAP_BUSY 1
+#define HEAP_CLASSES 12
+#define HEAP_MIN_SHIFT 4
+#define HEAP_MAX_SMALL (1ULL << (HEAP_MIN_SHIFT + HEAP_CLASSES - 1))
+#define HEAP_BATCH 32
+#define HEAP_LARGE HEAP_CLASSES
+
+/**
+ * Every block starts with this header; the payload follows it. Free blocks
+ * are linked through the first word of their payload by heap offset, so the
+ * lists are valid in every member no matter where it mapped the heap. magic
+ * is HEAP_MAGIC while the block is handed out and HEAP_FREE while it is on
+ * a free list or in a thread cache.
+ */
+struct heap_block
+{
+    __u64 size;
+    __u32 cls;
+    __u32 magic;
+};
+
+/**
+ * Metadata at the start of the heap object, shared by all members.
+ */
+struct heap_shared
+{
+    __u32 magic;
+    __u32 lock;
+    __u64 size;
+    __u64 bump;
+    __u64 free_head[HEAP_CLASSES + 1];
+};
+
+/**
+ * Blocks a thread freed or carved recently, reused without taking the heap lock.
+ */
+struct heap_cache
+{
+    __u64 head[HEAP_CLASSES];
+    int count[HEAP_CLASSES];
+};
+
+static struct heap_shared *heap = NULL;
+static pthread_key_t heap_cache_key;
+static __thread struct heap_cache *thread_cache = NULL;
+
+#define HEAP_FIRST ((sizeof(struct heap_shared) + 15) & ~15ULL)
+#define OFFSET(p) ((__u64)((char *)(p) - (char *)heap))
+#define BLOCK(off) ((struct heap_block *)((char *)heap + (off)))
+#define NEXT(off) (*(__u64 *)((char *)heap + (off) + sizeof(struct heap_block)))
+
+static void heap_lock(void)
+{
+    int spins = 0;
+    while (__atomic_exchange_n(&heap->lock, 1, __ATOMIC_ACQUIRE))
+    {
+        if (++spins % 64 == 0)
+            sched_yield();
+    }
+}
+
+static void heap_unlock(void)
+{
+    __atomic_store_n(&heap->lock, 0, __ATOMIC_RELEASE);
+}
+
+static int size_class(__u64 size)
+{
+    int cls = 0;
+    while ((1ULL << (HEAP_MIN_SHIFT + cls)) < size)
+        cls++;
+    return cls;
+}
+
+/**
+ * Carve a new block of the given payload size off the end of the heap.
+ * The caller holds the heap lock.
+ */
+static __u64 heap_carve(__u64 size, int cls)
+{
+    __u64 off = heap->bump;
+    struct heap_block *block;
+
+    if (off + sizeof(struct heap_block) + size > heap->size)
+        return 0;
+    heap->bump += sizeof(struct heap_block) + size;
+    block = BLOCK(off);
+    block->size = size;
+    block->cls = cls;
+    block->magic = HEAP_FREE;
+    return off;
+}
+
+/**
+ * Move up to HEAP_BATCH blocks of a class from the shared heap into the
+ * thread cache.
+ */
+static void cache_refill(struct heap_cache *cache, int cls)
+{
+    __u64 off;
+    int i;
+
+    heap_lock();
+    for (i = 0; i < HEAP_BATCH; i++)
+    {
+        off = heap->free_head[cls];
+        if (off)
+            heap->free_head[cls] = NEXT(off);
+        else if ((off = heap_carve(1ULL << (HEAP_MIN_SHIFT + cls), cls)) == 0)
+            break;
+        NEXT(off) = cache->head[cls];
+        cache->head[cls] = off;
+        cache->count[cls]++;
+    }
+    heap_unlock();
+}
+
+/**
+ * Return blocks of a class from the thread cache to the shared heap,
+ * keeping keep of them cached.
+ */
+static void cache_drain(struct heap_cache *cache, int cls, int keep)
+{
+    __u64 off;
+
+    heap_lock();
+    while (cache->count[cls] > keep)
+    {
+        off = cache->head[cls];
+        cache->head[cls] = NEXT(off);
+        cache->count[cls]--;
+        NEXT(off) = heap->free_head[cls];
+        heap->free_head[cls] = off;
+    }
+    heap_unlock();
+}
+
+static void cache_destroy(void *arg)
+{
+    struct heap_cache *cache = (struct heap_cache *)arg;
+    int cls;
+
+    for (cls = 0; cls < HEAP_CLASSES; cls++)
+        cache_drain(cache, cls, 0);
+    free(cache);
+}
+
+/**
+ * The blocks cached by the forking thread still belong to the parent; a
+ * child handing them out as well would share them with it, so it starts
+ * with an empty cache.
+ */
+static void cache_reset_child(void)
+{
+    if (thread_cache == NULL)
+        return;
+    free(thread_cache);
+    thread_cache = NULL;
+    pthread_setspecific(heap_cache_key, NULL);
+}
+
+static void heap_key_init(void)
+{
+    pthread_key_create(&heap_cache_key, cache_destroy);
+    pthread_atfork(NULL, NULL, cache_reset_child);
+}
+
+static struct heap_cache *get_cache(void)
+{
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+    if (thread_cache == NULL)
+    {
+        pthread_once(&once, heap_key_init);
+        thread_cache = (struct heap_cache *)calloc(1, sizeof(struct heap_cache));
+        pthread_setspecific(heap_cache_key, thread_cache);
+    }
+    return thread_cache;
+}
+
+/**
+ * Map object oid of the caller's container as the shared heap, formatting
+ * it if this is the first member to open it. Every member has to use the
+ * same oid and size.
+ */
+int mcontainer_heap_init(int devfd, __u64 oid, __u64 size)
+{
+    struct heap_shared *shared;
+    __u32 expected = 0;
+
+    shared = (struct heap_shared *)mcontainer_alloc(devfd, oid, size);
+    if (shared == MAP_FAILED)
+        return -1;
+    if (__atomic_compare_exchange_n(&shared->magic, &expected, HEAP_BUSY, 0, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+    {
+        shared->size = size;
+        shared->bump = HEAP_FIRST;
+        __atomic_store_n(&shared->magic, HEAP_MAGIC, __ATOMIC_RELEASE);
+    }
+    while (__atomic_load_n(&shared->magic, __ATOMIC_ACQUIRE) != HEAP_MAGIC)
+        sched_yield();
+    heap = shared;
+    return 0;
+}
+
+/**
+ * Allocate size bytes from the shared heap. Small sizes come from the
+ * calling thread's cache of its size class; larger ones take the heap lock.
+ */
+void *mcontainer_malloc(size_t size)
+{
+    struct heap_cache *cache;
+    __u64 off, *prev;
+    int cls;
+
+    if (heap == NULL)
+        return NULL;
+    if (size > HEAP_MAX_SMALL)
+    {
+        size = (size + 15) & ~(size_t)15;
+        heap_lock();
+        // first fit in the list of freed large blocks
+        for (prev = &heap->free_head[HEAP_LARGE]; (off = *prev) != 0; prev = &NEXT(off))
+        {
+            if (BLOCK(off)->size >= size)
+            {
+                *prev = NEXT(off);
+                break;
+            }
+        }
+        if (off == 0)
+            off = heap_carve(size, HEAP_LARGE);
+        heap_unlock();
+        if (off == 0)
+            return NULL;
+        BLOCK(off)->magic = HEAP_MAGIC;
+        return (char *)BLOCK(off) + sizeof(struct heap_block);
+    }
+
+    cls = size_class(size ? size : 1);
+    cache = get_cache();
+    if (cache == NULL)
+        return NULL;
+    if (cache->head[cls] == 0)
+        cache_refill(cache, cls);
+    if ((off = cache->head[cls]) == 0)
+        return NULL;
+    cache->head[cls] = NEXT(off);
+    cache->count[cls]--;
+    BLOCK(off)->magic = HEAP_MAGIC;
+    return (char *)BLOCK(off) + sizeof(struct heap_block);
+}
+
+/**
+ * Return a block from mcontainer_malloc() to the shared heap. Any member of
+ * the container may free blocks allocated by any other member. A pointer
+ * that is not a heap block, or a block that is already free, is ignored
+ * with errno set to EINVAL.
+ */
+void mcontainer_free_ptr(void *ptr)
+{
+    struct heap_cache *cache;
+    __u64 off;
+    __u32 expected = HEAP_MAGIC;
+    int cls;
+
+    if (ptr == NULL || heap == NULL)
+        return;
+    // only read a header that lies in the carved part of the heap
+    off = OFFSET(ptr);
+    if (off < HEAP_FIRST + sizeof(struct heap_block) || off >= __atomic_load_n(&heap->bump, __ATOMIC_ACQUIRE) || (off & 15))
+    {
+        errno = EINVAL;
+        return;
+    }
+    off -= sizeof(struct heap_block);
+    // a block freed twice, even by two members at once, goes on a list only once
+    if (!__atomic_compare_exchange_n(&BLOCK(off)->magic, &expected, HEAP_FREE, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+    {
+        errno = EINVAL;
+        return;
+    }
+    cls = BLOCK(off)->cls;
+    cache = cls == HEAP_LARGE ? NULL : get_cache();
+    if (cache == NULL)
+    {
+        heap_lock();
+        NEXT(off) = heap->free_head[cls];
+        heap->free_head[cls] = off;
+        heap_unlock();
+        return;
+    }
+    NEXT(off) = cache->head[cls];
+    cache->head[cls] = off;
+    if (++cache->count[cls] > 2 * HEAP_BATCH)
+        cache_drain(cache, cls, HEAP_BATCH);
+}
+
+/**
+ * Offset of a heap pointer, to hand to other members of the container
+ */
+__u64 mcontainer_heap_offset(void *ptr)
+{
+    return ptr == NULL ? 0 : OFFSET(ptr);
+}
+
+/**
+ * This member's address of a heap offset received from another member
+ */
+void *mcontainer_heap_ptr(__u64 offset)
+{
+    return offset == 0 || heap == NULL ? NULL : (char *)heap + offset;
+}
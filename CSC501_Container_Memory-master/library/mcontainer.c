@@ -31,6 +31,226 @@
 
 #include "mcontainer.h"
 
+#include <pthread.h>
+#include <string.h>
+
+#define MAPPING_BUCKETS 1024
+
+/**
+ * One cached mmap of an object. Container membership is per task, so the
+ * entry is keyed by the container the mapping task was in as well. Entries
+ * with no references are kept on an LRU list so they can be unmapped once
+ * the mapped bytes exceed the limit.
+ */
+struct mapping
+{
+    int devfd;
+    int cid;
+    __u64 oid;
+    __u64 size;
+    void *addr;
+    int refs;
+    struct mapping *next;
+    struct mapping *lru_prev;
+    struct mapping *lru_next;
+};
+
+static struct mapping *mappings[MAPPING_BUCKETS];
+// still referenced mappings of a container the task left, unmapped on their last release
+static struct mapping *retired = NULL;
+static struct mapping *lru_head = NULL, *lru_tail = NULL;
+static __u64 mapped_bytes = 0, mapped_limit = 0, cache_hits = 0;
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t cache_once = PTHREAD_ONCE_INIT;
+// container this thread joined with mcontainer_create(), -1 if none
+static __thread int current_cid = -1;
+
+/**
+ * Threads of this process in a container. Once none of them is left in it
+ * we no longer see its objects being freed and created again by other
+ * members, so our mappings of it are only kept while one of them is.
+ */
+struct member
+{
+    int devfd;
+    int cid;
+    int threads;
+    struct member *next;
+};
+
+static struct member *members = NULL;
+
+static char *arena_base = NULL;
+static __u64 arena_objects = 0;
+static __u64 arena_size = 0;
+
+static struct mapping **mapping_slot(int devfd, int cid, __u64 oid)
+{
+    struct mapping **m = &mappings[(oid ^ (__u64)devfd ^ ((__u64)cid << 16)) % MAPPING_BUCKETS];
+    while (*m != NULL && ((*m)->oid != oid || (*m)->devfd != devfd || (*m)->cid != cid))
+        m = &(*m)->next;
+    return m;
+}
+
+static void lru_remove(struct mapping *m)
+{
+    if (m->lru_prev)
+        m->lru_prev->lru_next = m->lru_next;
+    else
+        lru_head = m->lru_next;
+    if (m->lru_next)
+        m->lru_next->lru_prev = m->lru_prev;
+    else
+        lru_tail = m->lru_prev;
+    m->lru_prev = m->lru_next = NULL;
+}
+
+static void lru_append(struct mapping *m)
+{
+    m->lru_next = NULL;
+    m->lru_prev = lru_tail;
+    if (lru_tail)
+        lru_tail->lru_next = m;
+    else
+        lru_head = m;
+    lru_tail = m;
+}
+
+/**
+ * Forget the entry and unmap it. The caller holds cache_mutex.
+ */
+static void mapping_drop(struct mapping **slot)
+{
+    struct mapping *m = *slot;
+    if (m->refs == 0)
+        lru_remove(m);
+    *slot = m->next;
+    munmap(m->addr, m->size);
+    mapped_bytes -= m->size;
+    free(m);
+}
+
+/**
+ * Unmap least recently released objects until we are under the limit.
+ */
+static void mapping_trim(void)
+{
+    while (mapped_limit && mapped_bytes > mapped_limit && lru_head)
+        mapping_drop(mapping_slot(lru_head->devfd, lru_head->cid, lru_head->oid));
+}
+
+/**
+ * Forget the mappings of container cid: the task is leaving it, or joining
+ * it again after it may have been deleted and recreated with new objects.
+ * Mappings still referenced stay mapped on the retired list until released.
+ */
+static void mapping_flush(int devfd, int cid)
+{
+    int i;
+    struct mapping **slot, *m;
+
+    for (i = 0; i < MAPPING_BUCKETS; i++)
+    {
+        slot = &mappings[i];
+        while ((m = *slot) != NULL)
+        {
+            if (m->devfd != devfd || m->cid != cid)
+                slot = &m->next;
+            else if (m->refs == 0)
+                mapping_drop(slot);
+            else
+            {
+                *slot = m->next;
+                m->next = retired;
+                retired = m;
+            }
+        }
+    }
+}
+
+/**
+ * A forked child starts with an empty cache outside of any container; the
+ * inherited mappings stay valid but belong to whatever container the
+ * parent was in.
+ */
+static void cache_reset_child(void)
+{
+    int i;
+    struct mapping *m;
+    struct member *p;
+
+    pthread_mutex_init(&cache_mutex, NULL);
+    for (i = 0; i < MAPPING_BUCKETS; i++)
+    {
+        while ((m = mappings[i]) != NULL)
+        {
+            mappings[i] = m->next;
+            free(m);
+        }
+    }
+    while ((m = retired) != NULL)
+    {
+        retired = m->next;
+        free(m);
+    }
+    while ((p = members) != NULL)
+    {
+        members = p->next;
+        free(p);
+    }
+    // the child is not a member of the parent's container
+    current_cid = -1;
+    lru_head = lru_tail = NULL;
+    mapped_bytes = cache_hits = 0;
+}
+
+static void cache_init(void)
+{
+    pthread_atfork(NULL, NULL, cache_reset_child);
+}
+
+/**
+ * Count the calling thread in (join non-zero) or out of container cid,
+ * flushing our mappings of it when the first thread joins or the last one
+ * leaves.
+ */
+static void member_update(int devfd, int cid, int join)
+{
+    struct member **slot, *m;
+
+    pthread_once(&cache_once, cache_init);
+    pthread_mutex_lock(&cache_mutex);
+    slot = &members;
+    while (*slot != NULL && ((*slot)->devfd != devfd || (*slot)->cid != cid))
+        slot = &(*slot)->next;
+    m = *slot;
+    if (join)
+    {
+        if (m == NULL)
+        {
+            mapping_flush(devfd, cid);
+            if ((m = (struct member *)calloc(1, sizeof(struct member))) != NULL)
+            {
+                m->devfd = devfd;
+                m->cid = cid;
+                *slot = m;
+            }
+        }
+        if (m != NULL)
+            m->threads++;
+    }
+    else if (m == NULL || --m->threads == 0)
+    {
+        mapping_flush(devfd, cid);
+        if (m != NULL)
+        {
+            *slot = m->next;
+            free(m);
+        }
+    }
+    pthread_mutex_unlock(&cache_mutex);
+}
+
 /**
  * delete function in user space that sends command to kernel space
  * for deleting the current task in specified container.
@@ -38,6 +258,10 @@
 int mcontainer_delete(int devfd)
 {
     struct memory_container_cmd cmd;
+
+    if (current_cid != -1)
+        member_update(devfd, current_cid, 0);
+    current_cid = -1;
     return ioctl(devfd, MCONTAINER_IOCTL_DELETE, &cmd);
 }
 
@@ -48,21 +272,209 @@ int mcontainer_delete(int devfd)
 int mcontainer_create(int devfd, int cid)
 {
     struct memory_container_cmd cmd;
+    int ret;
+
     cmd.cid = cid;
-    return ioctl(devfd, MCONTAINER_IOCTL_CREATE, &cmd);
+    ret = ioctl(devfd, MCONTAINER_IOCTL_CREATE, &cmd);
+    if (ret == 0 && current_cid != cid)
+    {
+        if (current_cid != -1)
+            member_update(devfd, current_cid, 0);
+        member_update(devfd, cid, 1);
+        current_cid = cid;
+    }
+    return ret;
+}
+
+/**
+ * Map an object through the mapping cache; *cached tells whether an
+ * existing mapping was reused.
+ */
+static void *alloc_mapping(int devfd, __u64 offset, __u64 size, int *cached)
+{
+    __u64 aligned_size = ((size + getpagesize() - 1) / getpagesize()) * getpagesize();
+    struct mapping **slot, *m;
+    void *addr;
+
+    pthread_once(&cache_once, cache_init);
+    pthread_mutex_lock(&cache_mutex);
+    slot = mapping_slot(devfd, current_cid, offset);
+    *cached = 0;
+    if (*slot != NULL && (*slot)->size >= aligned_size)
+    {
+        m = *slot;
+        if (m->refs++ == 0)
+            lru_remove(m);
+        cache_hits++;
+        *cached = 1;
+        pthread_mutex_unlock(&cache_mutex);
+        return m->addr;
+    }
+    if (*slot != NULL && (*slot)->refs > 0)
+    {
+        // the smaller mapping is still in use and a second one could not be released by oid
+        pthread_mutex_unlock(&cache_mutex);
+        errno = EBUSY;
+        return MAP_FAILED;
+    }
+    if (*slot != NULL)
+        mapping_drop(slot);
+    if ((m = (struct mapping *)calloc(1, sizeof(struct mapping))) == NULL)
+    {
+        pthread_mutex_unlock(&cache_mutex);
+        errno = ENOMEM;
+        return MAP_FAILED;
+    }
+
+    addr = mmap(0, aligned_size, PROT_READ | PROT_WRITE, MAP_SHARED, devfd, offset * getpagesize());
+    if (addr == MAP_FAILED)
+        free(m);
+    else
+    {
+        m->devfd = devfd;
+        m->cid = current_cid;
+        m->oid = offset;
+        m->size = aligned_size;
+        m->addr = addr;
+        m->refs = 1;
+        *slot = m;
+        mapped_bytes += aligned_size;
+        mapping_trim();
+    }
+    pthread_mutex_unlock(&cache_mutex);
+    return addr;
 }
 
 /**
  * Allocate memory in kernel space for sharing along with tasks in the same container.
+ * Repeated calls for an object that is already mapped large enough return the
+ * existing address and take another reference; drop it with mcontainer_release().
  */
 void *mcontainer_alloc(int devfd, __u64 offset, __u64 size)
 {
-    __u64 aligned_size = ((size + getpagesize() - 1) / getpagesize()) * getpagesize();
-    return mmap(0, aligned_size, PROT_READ | PROT_WRITE, MAP_SHARED, devfd, offset * getpagesize());
+    int cached;
+    return alloc_mapping(devfd, offset, size, &cached);
+}
+
+/**
+ * mcontainer_alloc() for containers in cache mode: *miss is set when the
+ * object had been evicted (or never existed) and comes back zeroed.
+ */
+void *mcontainer_alloc_miss(int devfd, __u64 offset, __u64 size, int *miss)
+{
+    struct memory_container_stats stats;
+    int cached;
+    void *addr = alloc_mapping(devfd, offset, size, &cached);
+
+    // an object we still map cannot have been evicted
+    *miss = 0;
+    if (addr != MAP_FAILED && !cached && mcontainer_stats(devfd, &stats) == 0)
+        *miss = (int)stats.last_miss;
+    return addr;
+}
+
+/**
+ * Turn the container into a cache of at most budget bytes, evicting objects
+ * nobody maps or locks in policy order (MCONTAINER_EVICT_CLOCK or
+ * MCONTAINER_EVICT_LRU). A budget of 0 disables eviction.
+ */
+int mcontainer_cache(int devfd, __u64 budget, int policy)
+{
+    struct memory_container_cmd cmd;
+    cmd.op = policy;
+    cmd.size = budget;
+    return ioctl(devfd, MCONTAINER_IOCTL_CACHE, &cmd);
 }
 
 /**
- * Lock a memory page
+ * Read the hit, miss and eviction counters of the container
+ */
+int mcontainer_stats(int devfd, struct memory_container_stats *stats)
+{
+    return ioctl(devfd, MCONTAINER_IOCTL_STATS, stats);
+}
+
+/**
+ * Let the kernel merge objects of the container with identical contents
+ * (enable non-zero) or stop doing so. Merged objects are copied again
+ * before they are written; mcontainer_stats() reports the bytes saved.
+ */
+int mcontainer_dedup(int devfd, int enable)
+{
+    struct memory_container_cmd cmd;
+    cmd.op = enable;
+    return ioctl(devfd, MCONTAINER_IOCTL_DEDUP, &cmd);
+}
+
+/**
+ * Have the kernel compress objects of the container that were neither
+ * mapped nor touched for cold_ms milliseconds (0 turns it off). They are
+ * decompressed transparently on their next use; mcontainer_stats()
+ * reports the ratio and the time spent decompressing.
+ */
+int mcontainer_compress(int devfd, __u64 cold_ms)
+{
+    struct memory_container_cmd cmd;
+    cmd.size = cold_ms;
+    return ioctl(devfd, MCONTAINER_IOCTL_COMPRESS, &cmd);
+}
+
+/**
+ * Drop a reference taken by mcontainer_alloc(). The mapping stays cached
+ * until the object is freed or the mapped bytes exceed the cache limit;
+ * one of a container the caller has left is unmapped right away.
+ */
+int mcontainer_release(int devfd, __u64 offset)
+{
+    struct mapping **slot;
+    int ret = 0;
+
+    pthread_mutex_lock(&cache_mutex);
+    slot = mapping_slot(devfd, current_cid, offset);
+    if (*slot != NULL && (*slot)->refs > 0)
+    {
+        if (--(*slot)->refs == 0)
+        {
+            lru_append(*slot);
+            mapping_trim();
+        }
+    }
+    else
+    {
+        for (slot = &retired; *slot != NULL; slot = &(*slot)->next)
+            if ((*slot)->devfd == devfd && (*slot)->oid == offset)
+                break;
+        if (*slot == NULL)
+            ret = -1;
+        else if (--(*slot)->refs == 0)
+            mapping_drop(slot);
+    }
+    pthread_mutex_unlock(&cache_mutex);
+    return ret;
+}
+
+/**
+ * Cap the bytes kept mapped by the cache; 0 means no limit.
+ */
+void mcontainer_cache_limit(__u64 bytes)
+{
+    pthread_mutex_lock(&cache_mutex);
+    mapped_limit = bytes;
+    mapping_trim();
+    pthread_mutex_unlock(&cache_mutex);
+}
+
+/**
+ * Number of mcontainer_alloc() calls served from the cache
+ */
+__u64 mcontainer_cache_hits(void)
+{
+    return cache_hits;
+}
+
+/**
+ * Lock a memory page. Fails with errno EOWNERDEAD, but holding the lock,
+ * if the previous owner exited without unlocking it.
  */
 int mcontainer_lock(int devfd, __u64 offset)
 {
@@ -82,11 +494,317 @@ int mcontainer_unlock(int devfd, __u64 offset)
 }
 
 /**
- * removes an object from memory_container
+ * Unmap our cached mapping of an object, if any
+ */
+static void mapping_forget(int devfd, __u64 offset)
+{
+    struct mapping **slot;
+
+    pthread_mutex_lock(&cache_mutex);
+    slot = mapping_slot(devfd, current_cid, offset);
+    if (*slot != NULL)
+        mapping_drop(slot);
+    pthread_mutex_unlock(&cache_mutex);
+}
+
+/**
+ * removes an object from memory_container, unmapping our cached mapping of it
  */
 int mcontainer_free(int devfd, __u64 offset)
 {
     struct memory_container_cmd cmd;
+
+    mapping_forget(devfd, offset);
     cmd.oid = offset;
     return ioctl(devfd, MCONTAINER_IOCTL_FREE, &cmd);
-}
\ No newline at end of file
+}
+
+/**
+ * Map the whole object space of the container once. Every member has to
+ * pass the same geometry; object oid then lives at
+ * mcontainer_arena_object(oid) and is populated on first touch.
+ */
+void *mcontainer_arena(int devfd, __u64 objects, __u64 size)
+{
+    return mcontainer_arena_fixed(devfd, objects, size, NULL);
+}
+
+/**
+ * Like mcontainer_arena(), but if this is the first member to set up the
+ * arena of the container, a non-NULL addr pins it at that address, so
+ * pointers stored inside objects are valid in every member. The arena of a
+ * container first set up without an address cannot be pinned later: that
+ * fails with errno EINVAL. Members that cannot map a pinned arena at its
+ * address get NULL with errno set to EADDRINUSE.
+ */
+void *mcontainer_arena_fixed(int devfd, __u64 objects, __u64 size, void *addr)
+{
+    struct memory_container_cmd cmd;
+    int flags = MAP_SHARED;
+    void *base;
+
+    cmd.oid = objects;
+    cmd.size = size;
+    cmd.addr = (__u64)(unsigned long)addr;
+    if (ioctl(devfd, MCONTAINER_IOCTL_ARENA, &cmd) < 0)
+        return NULL;
+#ifdef MAP_FIXED_NOREPLACE
+    // never place it elsewhere, nor over something already mapped there
+    if (cmd.addr)
+        flags |= MAP_FIXED_NOREPLACE;
+#endif
+    base = mmap((void *)(unsigned long)cmd.addr, cmd.oid * cmd.size, PROT_READ | PROT_WRITE, flags, devfd, MCONTAINER_ARENA_PGOFF * getpagesize());
+    if (base != MAP_FAILED && cmd.addr && base != (void *)(unsigned long)cmd.addr)
+    {
+        // kernels without MAP_FIXED_NOREPLACE take the address as a hint only
+        munmap(base, cmd.oid * cmd.size);
+        base = MAP_FAILED;
+    }
+    if (base == MAP_FAILED)
+    {
+        // the module refuses to place a fixed arena anywhere else
+        if (cmd.addr)
+            errno = EADDRINUSE;
+        return NULL;
+    }
+    arena_base = (char *)base;
+    arena_objects = cmd.oid;
+    arena_size = cmd.size;
+    return base;
+}
+
+/**
+ * Address of an object inside the arena mapped by mcontainer_arena()
+ */
+void *mcontainer_arena_object(__u64 offset)
+{
+    if (arena_base == NULL || offset >= arena_objects)
+        return NULL;
+    return arena_base + offset * arena_size;
+}
+
+/**
+ * Populate the arena mappings of objects [offset, offset + count) in one call
+ */
+int mcontainer_arena_prefault(int devfd, __u64 offset, __u64 count)
+{
+    struct memory_container_cmd cmd;
+    cmd.oid = offset;
+    cmd.size = count;
+    cmd.addr = (__u64)(unsigned long)arena_base;
+    return ioctl(devfd, MCONTAINER_IOCTL_PREFAULT, &cmd);
+}
+
+/**
+ * Give the kernel an MCONTAINER_ADV_* hint for objects [offset, offset + count).
+ * MCONTAINER_ADV_WILLNEED also populates their arena mappings if there are any.
+ */
+int mcontainer_advise(int devfd, __u64 offset, __u64 count, int advice)
+{
+    struct memory_container_cmd cmd;
+    cmd.op = advice;
+    cmd.oid = offset;
+    cmd.size = count;
+    cmd.addr = (__u64)(unsigned long)arena_base;
+    return ioctl(devfd, MCONTAINER_IOCTL_ADVISE, &cmd);
+}
+
+/**
+ * Name object offset of size bytes with a string key
+ */
+int mcontainer_put(int devfd, const char *key, __u64 offset, __u64 size)
+{
+    struct memory_container_key_cmd cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    strncpy(cmd.key, key, MCONTAINER_KEY_MAX - 1);
+    cmd.oid = offset;
+    cmd.size = size;
+    return ioctl(devfd, MCONTAINER_IOCTL_PUT, &cmd);
+}
+
+/**
+ * Resolve a key and map its object with a single call. The oid and size of
+ * the object are returned through offset and size when they are not NULL.
+ * The mapping is not cached; unmap it with munmap().
+ */
+void *mcontainer_get(int devfd, const char *key, __u64 *offset, __u64 *size)
+{
+    struct memory_container_key_cmd cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    strncpy(cmd.key, key, MCONTAINER_KEY_MAX - 1);
+    if (ioctl(devfd, MCONTAINER_IOCTL_GET, &cmd) < 0)
+        return NULL;
+    if (offset)
+        *offset = cmd.oid;
+    if (size)
+        *size = cmd.size;
+    return (void *)(unsigned long)cmd.addr;
+}
+
+/**
+ * Remove a key and free the object it names
+ */
+int mcontainer_del(int devfd, const char *key)
+{
+    struct memory_container_key_cmd cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    strncpy(cmd.key, key, MCONTAINER_KEY_MAX - 1);
+    return ioctl(devfd, MCONTAINER_IOCTL_DEL, &cmd);
+}
+
+/**
+ * Compare-and-swap the 64-bit word at byte offset of an object in one call.
+ * If version is not NULL the swap also requires the object to be at
+ * *version, and the object's version is returned through it. Returns -1
+ * with errno EAGAIN when the word or the version did not match; *current
+ * (if not NULL) then holds the value found.
+ */
+int mcontainer_cas(int devfd, __u64 oid, __u64 offset, __u64 expected, __u64 desired, __u64 *current, __u64 *version)
+{
+    struct memory_container_cas_cmd cmd;
+    int ret;
+
+    cmd.oid = oid;
+    cmd.offset = offset;
+    cmd.expected = expected;
+    cmd.desired = desired;
+    cmd.version = version ? *version : MCONTAINER_ANY_VERSION;
+    ret = ioctl(devfd, MCONTAINER_IOCTL_CAS, &cmd);
+    if (ret == 0 || errno == EAGAIN)
+    {
+        if (current)
+            *current = cmd.expected;
+        if (version)
+            *version = cmd.version;
+    }
+    return ret;
+}
+
+/**
+ * Write size bytes (at most MCONTAINER_CWRITE_MAX) into an object if it is
+ * still at *version, or unconditionally when version is NULL.
+ */
+int mcontainer_cwrite(int devfd, __u64 oid, __u64 offset, const void *buf, __u64 size, __u64 *version)
+{
+    struct memory_container_cas_cmd cmd;
+    int ret;
+
+    cmd.oid = oid;
+    cmd.offset = offset;
+    cmd.buf = (__u64)(unsigned long)buf;
+    cmd.size = size;
+    cmd.version = version ? *version : MCONTAINER_ANY_VERSION;
+    ret = ioctl(devfd, MCONTAINER_IOCTL_CWRITE, &cmd);
+    if (version && (ret == 0 || errno == EAGAIN))
+        *version = cmd.version;
+    return ret;
+}
+
+/**
+ * Apply update to the 64-bit word at offset of an object, retrying the
+ * compare-and-swap until no other member raced with us. Returns the new
+ * value of the word, or sets errno and returns 0 if the CAS fails otherwise.
+ */
+__u64 mcontainer_update(int devfd, __u64 oid, __u64 offset, __u64 (*update)(__u64 old, void *arg), void *arg)
+{
+    __u64 old = 0, desired, current;
+
+    for (;;)
+    {
+        desired = update(old, arg);
+        if (mcontainer_cas(devfd, oid, offset, old, desired, &current, NULL) == 0)
+            return desired;
+        if (errno != EAGAIN)
+            return 0;
+        old = current;
+    }
+}
+
+static __u64 add_delta(__u64 old, void *arg)
+{
+    return old + *(__u64 *)arg;
+}
+
+/**
+ * Atomically add delta to the 64-bit counter at offset of an object
+ */
+__u64 mcontainer_add(int devfd, __u64 oid, __u64 offset, __u64 delta)
+{
+    return mcontainer_update(devfd, oid, offset, add_delta, &delta);
+}
+
+/**
+ * Freeze an object read-only and publish it under name so that other
+ * containers can map the same pages with mcontainer_attach(). Our cached
+ * writable mapping is dropped first; other members must unmap theirs.
+ */
+int mcontainer_publish(int devfd, __u64 offset, __u64 name)
+{
+    struct memory_container_publish_cmd cmd;
+
+    mapping_forget(devfd, offset);
+    cmd.oid = offset;
+    cmd.name = name;
+    return ioctl(devfd, MCONTAINER_IOCTL_PUBLISH, &cmd);
+}
+
+/**
+ * Make the object published under name object offset of our container and
+ * map it read-only. The size of the object is returned through size.
+ */
+const void *mcontainer_attach(int devfd, __u64 offset, __u64 name, __u64 *size)
+{
+    struct memory_container_publish_cmd cmd;
+    void *addr;
+
+    cmd.oid = offset;
+    cmd.name = name;
+    if (ioctl(devfd, MCONTAINER_IOCTL_ATTACH, &cmd) < 0)
+        return NULL;
+    addr = mmap(0, cmd.size, PROT_READ, MAP_SHARED, devfd, offset * getpagesize());
+    if (addr == MAP_FAILED)
+        return NULL;
+    if (size)
+        *size = cmd.size;
+    return addr;
+}
+
+/**
+ * Report a write of object offset made through a mapping to the files
+ * watching it, and wake the tasks of the container waiting on it.
+ */
+int mcontainer_notify(int devfd, __u64 offset)
+{
+    struct memory_container_wait_cmd cmd;
+    cmd.oid = offset;
+    cmd.offset = MCONTAINER_WAKE_OBJECT;
+    cmd.value = 0;
+    return ioctl(devfd, MCONTAINER_IOCTL_WAKE, &cmd);
+}
+
+/**
+ * Watch objects oids[0 .. count) for the MCONTAINER_WATCH_* events. devfd
+ * becomes readable when one of them changes; eventfd, if not -1, is
+ * signalled as well. A count of 0 stops watching.
+ */
+int mcontainer_watch(int devfd, const __u64 *oids, __u64 count, int events, int eventfd)
+{
+    struct memory_container_watch_cmd cmd;
+    cmd.oids = (__u64)(unsigned long)oids;
+    cmd.count = count;
+    cmd.events = events;
+    cmd.eventfd = eventfd;
+    return ioctl(devfd, MCONTAINER_IOCTL_WATCH, &cmd);
+}
+
+/**
+ * Collect up to max oids that changed since the last call, blocking until
+ * one does unless devfd is non-blocking. Returns how many were stored.
+ */
+int mcontainer_changed(int devfd, __u64 *oids, __u64 max)
+{
+    ssize_t n = read(devfd, oids, max * sizeof(__u64));
+    if (n < 0)
+        return -1;
+    return n / sizeof(__u64);
+}
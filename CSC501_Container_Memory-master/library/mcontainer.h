@@ -41,13 +41,44 @@ extern "C"
 #include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <errno.h>
 
     int mcontainer_delete(int devfd);
     int mcontainer_create(int devfd, int cid);
     void *mcontainer_alloc(int devfd, __u64 offset, __u64 size);
+    void *mcontainer_alloc_miss(int devfd, __u64 offset, __u64 size, int *miss);
+    int mcontainer_cache(int devfd, __u64 budget, int policy);
+    int mcontainer_stats(int devfd, struct memory_container_stats *stats);
+    int mcontainer_dedup(int devfd, int enable);
+    int mcontainer_compress(int devfd, __u64 cold_ms);
     int mcontainer_lock(int devfd, __u64 offset);
     int mcontainer_unlock(int devfd, __u64 offset);
     int mcontainer_free(int devfd, __u64 offset);
+    int mcontainer_release(int devfd, __u64 offset);
+    void mcontainer_cache_limit(__u64 bytes);
+    __u64 mcontainer_cache_hits(void);
+    void *mcontainer_arena(int devfd, __u64 objects, __u64 size);
+    void *mcontainer_arena_fixed(int devfd, __u64 objects, __u64 size, void *addr);
+    void *mcontainer_arena_object(__u64 offset);
+    int mcontainer_arena_prefault(int devfd, __u64 offset, __u64 count);
+    int mcontainer_advise(int devfd, __u64 offset, __u64 count, int advice);
+    int mcontainer_put(int devfd, const char *key, __u64 offset, __u64 size);
+    void *mcontainer_get(int devfd, const char *key, __u64 *offset, __u64 *size);
+    int mcontainer_del(int devfd, const char *key);
+    int mcontainer_cas(int devfd, __u64 oid, __u64 offset, __u64 expected, __u64 desired, __u64 *current, __u64 *version);
+    int mcontainer_cwrite(int devfd, __u64 oid, __u64 offset, const void *buf, __u64 size, __u64 *version);
+    __u64 mcontainer_update(int devfd, __u64 oid, __u64 offset, __u64 (*update)(__u64 old, void *arg), void *arg);
+    __u64 mcontainer_add(int devfd, __u64 oid, __u64 offset, __u64 delta);
+    int mcontainer_publish(int devfd, __u64 offset, __u64 name);
+    const void *mcontainer_attach(int devfd, __u64 offset, __u64 name, __u64 *size);
+    int mcontainer_notify(int devfd, __u64 offset);
+    int mcontainer_watch(int devfd, const __u64 *oids, __u64 count, int events, int eventfd);
+    int mcontainer_changed(int devfd, __u64 *oids, __u64 max);
+    int mcontainer_heap_init(int devfd, __u64 offset, __u64 size);
+    void *mcontainer_malloc(size_t size);
+    void mcontainer_free_ptr(void *ptr);
+    __u64 mcontainer_heap_offset(void *ptr);
+    void *mcontainer_heap_ptr(__u64 offset);
 
 #ifdef __cplusplus
 }
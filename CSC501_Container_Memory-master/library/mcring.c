@@ -0,0 +1,290 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+//
+//
+//                             Copyright 2016
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Author:  Hung-Wei Tseng, Yu-Chia Liu
+//
+//   Description:
+//     Lock-free Rings in Memory Container Objects
+//
+////////////////////////////////////////////////////////////////////////
+
+#include "mcring.h"
+
+#include <stddef.h>
+#include <string.h>
+#include <sched.h>
+
+#define MCRING_MAGIC 0x6d637267
+#define MCRING_BUSY 1
+#define MCRING_SPIN 128
+
+/**
+ * MPMC slots start with a sequence number that tells producers and
+ * consumers whose turn the slot is; SPSC slots ignore it.
+ */
+struct mcring_slot
+{
+    __u64 seq;
+    char data[];
+};
+
+static struct mcring_slot *slot_at(struct mcring *ring, __u64 pos)
+{
+    return (struct mcring_slot *)(ring->slots + (pos & (ring->shared->capacity - 1)) * ring->shared->slot_size);
+}
+
+/**
+ * Wake tasks sleeping on *seq, but only when the waiter count says there are
+ * any, so the common uncontended case never enters the kernel.
+ */
+static void ring_notify(struct mcring *ring, __u32 *seq, __u32 *waiters)
+{
+    struct memory_container_wait_cmd cmd;
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(waiters, __ATOMIC_RELAXED) == 0)
+        return;
+    __atomic_fetch_add(seq, 1, __ATOMIC_SEQ_CST);
+    cmd.oid = ring->oid;
+    cmd.offset = (char *)seq - (char *)ring->shared;
+    cmd.value = 0;
+    ioctl(ring->devfd, MCONTAINER_IOCTL_WAKE, &cmd);
+}
+
+/**
+ * Sleep in the kernel on *seq until the other side calls ring_notify().
+ * The waiter count is raised before the last retry, so either that retry
+ * succeeds or the other side sees us and bumps *seq.
+ */
+static int ring_block(struct mcring *ring, __u32 *seq, __u32 *waiters,
+                      int (*retry)(struct mcring *, void *), void *elem)
+{
+    struct memory_container_wait_cmd cmd;
+    int i;
+
+    for (;;)
+    {
+        for (i = 0; i < MCRING_SPIN; i++)
+        {
+            if (retry(ring, elem) == 0)
+                return 0;
+        }
+        cmd.value = __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+        __atomic_fetch_add(waiters, 1, __ATOMIC_SEQ_CST);
+        if (retry(ring, elem) == 0)
+        {
+            __atomic_fetch_sub(waiters, 1, __ATOMIC_SEQ_CST);
+            return 0;
+        }
+        cmd.oid = ring->oid;
+        cmd.offset = (char *)seq - (char *)ring->shared;
+        if (ioctl(ring->devfd, MCONTAINER_IOCTL_WAIT, &cmd) < 0 && errno != EINTR)
+        {
+            __atomic_fetch_sub(waiters, 1, __ATOMIC_SEQ_CST);
+            return -1;
+        }
+        __atomic_fetch_sub(waiters, 1, __ATOMIC_SEQ_CST);
+    }
+}
+
+/**
+ * Attach to the ring in object oid (mapped at object), creating it if this
+ * is the first task to open it. Every task has to pass the same elem_size
+ * and flags (MCRING_SPSC or MCRING_MPMC).
+ */
+int mcring_open(struct mcring *ring, int devfd, __u64 oid, void *object, __u64 object_size, __u64 elem_size, int flags)
+{
+    struct mcring_shared *shared = (struct mcring_shared *)object;
+    __u32 expected = 0;
+    __u64 slot_size = (sizeof(struct mcring_slot) + elem_size + 7) & ~7ULL;
+    __u64 capacity = 1, i;
+
+    if (object == NULL || elem_size == 0 || object_size < sizeof(*shared) + slot_size)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    ring->shared = shared;
+    ring->slots = (char *)object + sizeof(*shared);
+    ring->devfd = devfd;
+    ring->oid = oid;
+
+    if (__atomic_compare_exchange_n(&shared->magic, &expected, MCRING_BUSY, 0, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+    {
+        // largest power of two that fits behind the header
+        while (sizeof(*shared) + capacity * 2 * slot_size <= object_size)
+            capacity *= 2;
+        shared->flags = flags;
+        shared->capacity = capacity;
+        shared->elem_size = elem_size;
+        shared->slot_size = slot_size;
+        shared->head = shared->tail = 0;
+        for (i = 0; i < capacity; i++)
+            slot_at(ring, i)->seq = i;
+        __atomic_store_n(&shared->magic, MCRING_MAGIC, __ATOMIC_RELEASE);
+    }
+    while (__atomic_load_n(&shared->magic, __ATOMIC_ACQUIRE) != MCRING_MAGIC)
+        sched_yield();
+
+    if (shared->elem_size != elem_size || shared->flags != (__u32)flags)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+static int spsc_push(struct mcring *ring, const void *elem)
+{
+    struct mcring_shared *shared = ring->shared;
+    __u64 tail = __atomic_load_n(&shared->tail, __ATOMIC_RELAXED);
+
+    if (tail - __atomic_load_n(&shared->head, __ATOMIC_ACQUIRE) == shared->capacity)
+        return -1;
+    memcpy(slot_at(ring, tail)->data, elem, shared->elem_size);
+    __atomic_store_n(&shared->tail, tail + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+static int spsc_pop(struct mcring *ring, void *elem)
+{
+    struct mcring_shared *shared = ring->shared;
+    __u64 head = __atomic_load_n(&shared->head, __ATOMIC_RELAXED);
+
+    if (head == __atomic_load_n(&shared->tail, __ATOMIC_ACQUIRE))
+        return -1;
+    memcpy(elem, slot_at(ring, head)->data, shared->elem_size);
+    __atomic_store_n(&shared->head, head + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+static int mpmc_push(struct mcring *ring, const void *elem)
+{
+    struct mcring_shared *shared = ring->shared;
+    struct mcring_slot *slot;
+    __u64 pos = __atomic_load_n(&shared->tail, __ATOMIC_RELAXED);
+    long long diff;
+
+    for (;;)
+    {
+        slot = slot_at(ring, pos);
+        diff = (long long)(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - pos);
+        if (diff == 0)
+        {
+            if (__atomic_compare_exchange_n(&shared->tail, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        }
+        else if (diff < 0)
+            return -1;
+        else
+            pos = __atomic_load_n(&shared->tail, __ATOMIC_RELAXED);
+    }
+    memcpy(slot->data, elem, shared->elem_size);
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+static int mpmc_pop(struct mcring *ring, void *elem)
+{
+    struct mcring_shared *shared = ring->shared;
+    struct mcring_slot *slot;
+    __u64 pos = __atomic_load_n(&shared->head, __ATOMIC_RELAXED);
+    long long diff;
+
+    for (;;)
+    {
+        slot = slot_at(ring, pos);
+        diff = (long long)(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - (pos + 1));
+        if (diff == 0)
+        {
+            if (__atomic_compare_exchange_n(&shared->head, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        }
+        else if (diff < 0)
+            return -1;
+        else
+            pos = __atomic_load_n(&shared->head, __ATOMIC_RELAXED);
+    }
+    memcpy(elem, slot->data, shared->elem_size);
+    __atomic_store_n(&slot->seq, pos + shared->capacity, __ATOMIC_RELEASE);
+    return 0;
+}
+
+static int ring_push(struct mcring *ring, void *elem)
+{
+    if (ring->shared->flags == MCRING_MPMC)
+        return mpmc_push(ring, elem);
+    return spsc_push(ring, elem);
+}
+
+static int ring_pop(struct mcring *ring, void *elem)
+{
+    if (ring->shared->flags == MCRING_MPMC)
+        return mpmc_pop(ring, elem);
+    return spsc_pop(ring, elem);
+}
+
+/**
+ * Append elem to the ring; returns -1 without blocking if the ring is full.
+ */
+int mcring_try_push(struct mcring *ring, const void *elem)
+{
+    if (ring_push(ring, (void *)elem) < 0)
+        return -1;
+    ring_notify(ring, &ring->shared->not_empty_seq, &ring->shared->not_empty_waiters);
+    return 0;
+}
+
+/**
+ * Take the oldest element off the ring; returns -1 without blocking if empty.
+ */
+int mcring_try_pop(struct mcring *ring, void *elem)
+{
+    if (ring_pop(ring, elem) < 0)
+        return -1;
+    ring_notify(ring, &ring->shared->not_full_seq, &ring->shared->not_full_waiters);
+    return 0;
+}
+
+/**
+ * Append elem, sleeping in the kernel while the ring is full.
+ */
+int mcring_push(struct mcring *ring, const void *elem)
+{
+    if (ring_block(ring, &ring->shared->not_full_seq, &ring->shared->not_full_waiters, ring_push, (void *)elem) < 0)
+        return -1;
+    ring_notify(ring, &ring->shared->not_empty_seq, &ring->shared->not_empty_waiters);
+    return 0;
+}
+
+/**
+ * Take the oldest element, sleeping in the kernel while the ring is empty.
+ */
+int mcring_pop(struct mcring *ring, void *elem)
+{
+    if (ring_block(ring, &ring->shared->not_empty_seq, &ring->shared->not_empty_waiters, ring_pop, elem) < 0)
+        return -1;
+    ring_notify(ring, &ring->shared->not_full_seq, &ring->shared->not_full_waiters);
+    return 0;
+}
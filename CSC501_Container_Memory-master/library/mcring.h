@@ -0,0 +1,94 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+//
+//
+//                             Copyright 2016
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Author:  Hung-Wei Tseng, Yu-Chia Liu
+//
+//   Description:
+//     Lock-free Rings in Memory Container Objects
+//
+////////////////////////////////////////////////////////////////////////
+
+#ifndef MCRING_H
+#define MCRING_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "mcontainer.h"
+
+#define MCRING_SPSC 0
+#define MCRING_MPMC 1
+
+#define MCRING_CACHE_LINE 64
+
+    /**
+     * Header at the start of the container object that holds the ring. The
+     * producer and consumer indices live on their own cache lines. The
+     * *_seq words are what blocked tasks sleep on in the kernel; they only
+     * move when the matching *_waiters count says someone is asleep.
+     */
+    struct mcring_shared
+    {
+        __u32 magic;
+        __u32 flags;
+        __u64 capacity;
+        __u64 elem_size;
+        __u64 slot_size;
+        char pad0[MCRING_CACHE_LINE - 32];
+
+        __u64 head __attribute__((aligned(MCRING_CACHE_LINE)));
+        __u32 not_full_seq;
+        __u32 not_full_waiters;
+        char pad1[MCRING_CACHE_LINE - 16];
+
+        __u64 tail __attribute__((aligned(MCRING_CACHE_LINE)));
+        __u32 not_empty_seq;
+        __u32 not_empty_waiters;
+        char pad2[MCRING_CACHE_LINE - 16];
+    };
+
+    /**
+     * Per-task handle of a ring living in object oid, mapped at shared.
+     */
+    struct mcring
+    {
+        struct mcring_shared *shared;
+        char *slots;
+        int devfd;
+        __u64 oid;
+    };
+
+    int mcring_open(struct mcring *ring, int devfd, __u64 oid, void *object, __u64 object_size, __u64 elem_size, int flags);
+    int mcring_try_push(struct mcring *ring, const void *elem);
+    int mcring_try_pop(struct mcring *ring, void *elem);
+    int mcring_push(struct mcring *ring, const void *elem);
+    int mcring_pop(struct mcring *ring, void *elem);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,8 +1,8 @@
 #!/bin/bash
 
 # Parse input
-if [ $# -ne 4 ]; then
-    echo "Usage: $0 <# of objects> <max size of objects> <# of tasks> <# of containers>"
+if [ $# -ne 4 ] && [ $# -ne 5 ]; then
+    echo "Usage: $0 <# of objects> <max size of objects> <# of tasks> <# of containers> [arena]"
     exit
 fi
 
@@ -11,9 +11,10 @@ max_size_of_objects=$2
 number_of_processes=$3
 number_of_containers=$4
 
+sudo modprobe -a lz4_compress lz4_decompress
 sudo insmod kernel_module/memory_container.ko
 sudo chmod 777 /dev/mcontainer
-./benchmark/benchmark $1 $2 $3 $4
+./benchmark/benchmark $1 $2 $3 $4 $5
 cat *.log > trace
 sort -n -k 4 trace > sorted_trace
 ./benchmark/validate $1 $2 $4 < sorted_trace
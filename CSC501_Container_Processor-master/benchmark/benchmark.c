@@ -15,6 +15,9 @@
 int devfd;
 pthread_mutex_t mutex;
 int total = 0;
+unsigned long *weights;
+double *cpu_time;
+int parallel = 0;
 
 /**
  * Thread body that creates task in a specified container, does some simple calculations
@@ -27,8 +30,14 @@ void *thread_body(void *x)
     double sum;
     int cid = *((int *)x);
 
+    struct timespec used;
+
     // allocate/associate a container for the thread.
     pcontainer_create(devfd, cid);
+    if (weights[cid] != 0)
+        pcontainer_weight(devfd, cid, weights[cid]);
+    if (parallel != 0)
+        pcontainer_parallel(devfd, cid, parallel);
 
     while (total < 50000000)
     {
@@ -44,6 +53,12 @@ void *thread_body(void *x)
         total += 1000000;
         pthread_mutex_unlock(&mutex);
     }
+    // account the processor time of the thread to its container.
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &used);
+    pthread_mutex_lock(&mutex);
+    cpu_time[cid] += used.tv_sec + used.tv_nsec / 1e9;
+    pthread_mutex_unlock(&mutex);
+
     // The sum of each container should be close.
     //fprintf(stderr, "TID: %d, Container: %d, Processed: %d\n", (int)syscall(SYS_gettid), cid, processed);
     // Delete a container.
@@ -58,17 +73,41 @@ void *thread_body(void *x)
  */
 int main(int argc, char *argv[])
 {
-    int i, num_of_containers, tasks;
+    int i, num_of_containers, tasks, opt;
     int total_tasks = 0; 
     int *tasks_in_containers;
     int *cid;
     pthread_t *threads;
+    char *weight_list = NULL, *w;
+    unsigned long weight_sum = 0;
+    double cpu_sum = 0;
+    struct timespec start, end;
+    double elapsed;
+
+    // parse options.
+    while ((opt = getopt(argc, argv, "w:p:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'w':
+            weight_list = optarg;
+            break;
+        case 'p':
+            parallel = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: ./benchmark [-w <weight>,...] [-p <running_tasks_per_container>] <num_container> [<num_task_in_container> ...]\n");
+            exit(1);
+        }
+    }
+    argc -= optind - 1;
+    argv += optind - 1;
 
     // check num of arguments.
     if (argc < 3)
     {
         fprintf(stderr, "Not enough parameters\n");
-        fprintf(stderr, "usage: ./benchmark <num_container> [<num_task_in_container> ...]\n");
+        fprintf(stderr, "usage: ./benchmark [-w <weight>,...] [-p <running_tasks_per_container>] <num_container> [<num_task_in_container> ...]\n");
         exit(1);
     }
     
@@ -88,13 +127,22 @@ int main(int argc, char *argv[])
     if (argc - 2 < num_of_containers)
     {
         fprintf(stderr, "Not enough parameters\n");
-        fprintf(stderr, "usage: ./benchmark <num_container> [<num_task_in_container> ...]\n");
+        fprintf(stderr, "usage: ./benchmark [-w <weight>,...] [-p <running_tasks_per_container>] <num_container> [<num_task_in_container> ...]\n");
         exit(1);
     }
     
     // generate and store number of tasks and cid for each container.
     tasks_in_containers = (int *) calloc(num_of_containers, sizeof(int));
     cid = (int *) calloc(num_of_containers, sizeof(int));
+    weights = (unsigned long *) calloc(num_of_containers, sizeof(unsigned long));
+    cpu_time = (double *) calloc(num_of_containers, sizeof(double));
+
+    // containers without a weight keep the default one.
+    for (i = 0, w = weight_list; w != NULL && i < num_of_containers; i++)
+    {
+        weights[i] = strtoul(w, &w, 10);
+        w = *w == ',' ? w + 1 : NULL;
+    }
 
     for (i = 0; i < num_of_containers; i++)
     {
@@ -116,6 +164,7 @@ int main(int argc, char *argv[])
 
     // reset the total task for assigning the thread array.
     total_tasks = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
 
     for (i = 0; i < num_of_containers; i++)
     {
@@ -131,8 +180,26 @@ int main(int argc, char *argv[])
     {
         pthread_join(threads[i], NULL);
     }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("Elapsed: %.3fs, Throughput: %.1f M/s\n", elapsed, total / elapsed / 1e6);
+
+    // report the share of processor time each container achieved.
+    for (i = 0; i < num_of_containers; i++)
+    {
+        weight_sum += weights[i] ? weights[i] : PCONTAINER_WEIGHT_DEFAULT;
+        cpu_sum += cpu_time[i];
+    }
+    for (i = 0; i < num_of_containers && cpu_sum > 0; i++)
+    {
+        unsigned long weight = weights[i] ? weights[i] : PCONTAINER_WEIGHT_DEFAULT;
+        printf("Container: %d, Weight: %lu, CPU: %.3fs, Share: %.1f%%, Expected: %.1f%%\n", i, weight,
+               cpu_time[i], 100.0 * cpu_time[i] / cpu_sum, 100.0 * weight / weight_sum);
+    }
 
     // cleanup
+    free(weights);
+    free(cpu_time);
     free(tasks_in_containers);
     free(threads);
     free(cid);
@@ -0,0 +1,333 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pcontainer.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+
+typedef struct processor_container_trace_event event;
+typedef struct processor_container_trace_ring ring;
+
+/**
+ * What the events tell about a thread.
+ */
+struct thread
+{
+    int pid;
+    int cid;
+    unsigned long long run_ns;
+    unsigned long long running_since; // 0 while it holds no processor
+    unsigned long long waiting_since; // 0 while it does not wait for one
+    unsigned long long granted_at; // last RUN, to time the wakeup
+    unsigned long long wait_ns, max_wait_ns, waits;
+    unsigned long long resume_ns, resumes;
+    unsigned long long runs, blocks;
+};
+
+/**
+ * Totals of a container.
+ */
+struct container
+{
+    int cid;
+    int threads;
+    unsigned long long run_ns;
+    double sum, sum_sq; // of the run time of its threads, for the fairness index
+    unsigned long long wait_ns, max_wait_ns, waits;
+    unsigned long long resume_ns, resumes;
+    unsigned long long runs, blocks;
+};
+
+static const char *names[] = { "?", "CREATE", "RUN", "WAKE", "RESUME", "STOP", "BLOCK", "DELETE" };
+
+event *events;
+size_t nevents, maxevents;
+unsigned long long lost;
+struct thread *threads;
+int nthreads;
+struct container *containers;
+int ncontainers;
+volatile sig_atomic_t stop;
+
+static void interrupted(int sig)
+{
+    (void)sig;
+    stop = 1;
+}
+
+/**
+ * copy the events the kernel wrote to a ring since the last drain.
+ */
+static void drain(const ring *r, unsigned long long *tail)
+{
+    const event *ev = (const event *)((const char *)r + PCONTAINER_TRACE_HEADER);
+    unsigned long long head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    unsigned long long i, start = nevents, overwritten;
+
+    if (head - *tail > PCONTAINER_TRACE_EVENTS)
+    {
+        lost += head - *tail - PCONTAINER_TRACE_EVENTS;
+        *tail = head - PCONTAINER_TRACE_EVENTS;
+    }
+    for (i = *tail; i < head; i++)
+    {
+        if (nevents == maxevents)
+        {
+            maxevents = maxevents ? maxevents * 2 : 65536;
+            events = realloc(events, maxevents * sizeof(event));
+        }
+        events[nevents++] = ev[i % PCONTAINER_TRACE_EVENTS];
+    }
+    // events the kernel may have overwritten while they were copied
+    head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    overwritten = head > PCONTAINER_TRACE_EVENTS ? head - PCONTAINER_TRACE_EVENTS : 0;
+    for (i = *tail; i < overwritten && i < *tail + (nevents - start); i++)
+    {
+        events[start + (i - *tail)].type = 0;
+        lost++;
+    }
+    *tail += nevents - start;
+}
+
+static int by_time(const void *a, const void *b)
+{
+    const event *x = a, *y = b;
+
+    return x->ts < y->ts ? -1 : x->ts > y->ts;
+}
+
+static struct thread *find_thread(int pid)
+{
+    int i;
+
+    for (i = 0; i < nthreads; i++)
+        if (threads[i].pid == pid)
+            return &threads[i];
+    threads = realloc(threads, (nthreads + 1) * sizeof(struct thread));
+    memset(&threads[nthreads], 0, sizeof(struct thread));
+    threads[nthreads].pid = pid;
+    return &threads[nthreads++];
+}
+
+static struct container *find_container(int cid)
+{
+    int i;
+
+    for (i = 0; i < ncontainers; i++)
+        if (containers[i].cid == cid)
+            return &containers[i];
+    containers = realloc(containers, (ncontainers + 1) * sizeof(struct container));
+    memset(&containers[ncontainers], 0, sizeof(struct container));
+    containers[ncontainers].cid = cid;
+    return &containers[ncontainers++];
+}
+
+/**
+ * the thread no longer holds a processor.
+ */
+static void stopped(struct thread *t, unsigned long long ts)
+{
+    if (t->running_since)
+        t->run_ns += ts - t->running_since;
+    t->running_since = 0;
+}
+
+/**
+ * replay the events in time order to rebuild what every thread did.
+ */
+static void replay(int verbose)
+{
+    size_t i;
+    unsigned long long first = nevents ? events[0].ts : 0;
+
+    for (i = 0; i < nevents; i++)
+    {
+        event *ev = &events[i];
+        struct thread *t;
+
+        if (ev->type == 0 || ev->type > PCONTAINER_EV_DELETE)
+            continue;
+        if (verbose)
+            printf("%14.3f us cpu %3u cid %4d pid %6d %s\n", (ev->ts - first) / 1e3, ev->cpu, ev->cid, ev->pid, names[ev->type]);
+        t = find_thread(ev->pid);
+        t->cid = ev->cid;
+        switch (ev->type)
+        {
+        case PCONTAINER_EV_CREATE:
+            t->waiting_since = ev->ts;
+            break;
+        case PCONTAINER_EV_RUN:
+            if (t->waiting_since)
+            {
+                unsigned long long wait = ev->ts - t->waiting_since;
+
+                t->wait_ns += wait;
+                t->waits++;
+                if (wait > t->max_wait_ns)
+                    t->max_wait_ns = wait;
+            }
+            t->waiting_since = 0;
+            t->running_since = t->granted_at = ev->ts;
+            t->runs++;
+            break;
+        case PCONTAINER_EV_RESUME:
+            if (t->granted_at)
+            {
+                t->resume_ns += ev->ts - t->granted_at;
+                t->resumes++;
+            }
+            t->granted_at = 0;
+            break;
+        case PCONTAINER_EV_STOP:
+            stopped(t, ev->ts);
+            t->waiting_since = ev->ts;
+            break;
+        case PCONTAINER_EV_BLOCK:
+            stopped(t, ev->ts);
+            t->blocks++;
+            break;
+        case PCONTAINER_EV_DELETE:
+            stopped(t, ev->ts);
+            t->waiting_since = 0;
+            break;
+        }
+    }
+    // threads still running when the trace ended
+    for (i = 0; i < (size_t)nthreads && nevents; i++)
+        stopped(&threads[i], events[nevents - 1].ts);
+}
+
+/**
+ * Jain's fairness index of n values, 1 when they are all equal, 1/n when one
+ * of them got everything.
+ */
+static double fairness(double sum, double sum_sq, int n)
+{
+    return sum_sq > 0 ? sum * sum / (n * sum_sq) : 1;
+}
+
+static void report(void)
+{
+    int i;
+    double total = 0, total_sq = 0;
+
+    for (i = 0; i < nthreads; i++)
+    {
+        struct thread *t = &threads[i];
+        struct container *c = find_container(t->cid);
+
+        c->threads++;
+        c->run_ns += t->run_ns;
+        c->sum += t->run_ns;
+        c->sum_sq += (double)t->run_ns * t->run_ns;
+        c->wait_ns += t->wait_ns;
+        c->waits += t->waits;
+        if (t->max_wait_ns > c->max_wait_ns)
+            c->max_wait_ns = t->max_wait_ns;
+        c->resume_ns += t->resume_ns;
+        c->resumes += t->resumes;
+        c->runs += t->runs;
+        c->blocks += t->blocks;
+    }
+    for (i = 0; i < ncontainers; i++)
+    {
+        total += containers[i].run_ns;
+        total_sq += (double)containers[i].run_ns * containers[i].run_ns;
+    }
+    printf("Events: %zu, Lost: %llu\n", nevents, lost);
+    for (i = 0; i < ncontainers; i++)
+    {
+        struct container *c = &containers[i];
+
+        printf("Container: %d, Threads: %d, Run: %.3f ms, Share: %.1f%%, Runs: %llu, Blocks: %llu, "
+               "Wait avg: %.1f us, Wait max: %.1f us, Wakeup avg: %.1f us, Fairness: %.3f\n",
+               c->cid, c->threads, c->run_ns / 1e6, total > 0 ? 100.0 * c->run_ns / total : 0, c->runs, c->blocks,
+               c->waits ? c->wait_ns / 1e3 / c->waits : 0, c->max_wait_ns / 1e3,
+               c->resumes ? c->resume_ns / 1e3 / c->resumes : 0, fairness(c->sum, c->sum_sq, c->threads));
+    }
+    if (ncontainers)
+        printf("Fairness between containers: %.3f\n", fairness(total, total_sq, ncontainers));
+}
+
+/**
+ * main function to drain the trace rings of the processor container module
+ * for a while and report per container timelines and fairness.
+ */
+int main(int argc, char *argv[])
+{
+    int devfd, opt, cpu, nr_cpus, verbose = 0;
+    double seconds = 0;
+    const ring *header;
+    const char *rings;
+    unsigned long long *tails;
+    struct timespec start, now;
+
+    while ((opt = getopt(argc, argv, "s:v")) != -1)
+    {
+        switch (opt)
+        {
+        case 's':
+            seconds = atof(optarg);
+            break;
+        case 'v':
+            verbose = 1;
+            break;
+        default:
+            fprintf(stderr, "usage: ./pctrace [-s <seconds>] [-v]\n");
+            exit(1);
+        }
+    }
+
+    // open the kernel module and map its rings
+    devfd = open("/dev/pcontainer", O_RDONLY);
+    if (devfd < 0)
+    {
+        fprintf(stderr, "Device open failed\n");
+        exit(1);
+    }
+    header = mmap(NULL, PCONTAINER_TRACE_HEADER, PROT_READ, MAP_SHARED, devfd, 0);
+    if (header == MAP_FAILED)
+    {
+        fprintf(stderr, "Trace is not available\n");
+        exit(1);
+    }
+    nr_cpus = header->nr_cpus;
+    munmap((void *)header, PCONTAINER_TRACE_HEADER);
+    rings = mmap(NULL, nr_cpus * PCONTAINER_TRACE_SEGMENT, PROT_READ, MAP_SHARED, devfd, 0);
+    if (rings == MAP_FAILED)
+    {
+        fprintf(stderr, "Trace is not available\n");
+        exit(1);
+    }
+    tails = calloc(nr_cpus, sizeof(unsigned long long));
+
+    // drain until the time is up or ^C, starting with what the rings still hold
+    signal(SIGINT, interrupted);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (!stop)
+    {
+        for (cpu = 0; cpu < nr_cpus; cpu++)
+            drain((const ring *)(rings + cpu * PCONTAINER_TRACE_SEGMENT), &tails[cpu]);
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (seconds > 0 && (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9 >= seconds)
+            break;
+        usleep(10000);
+    }
+
+    qsort(events, nevents, sizeof(event), by_time);
+    replay(verbose);
+    report();
+
+    munmap((void *)rings, nr_cpus * PCONTAINER_TRACE_SEGMENT);
+    close(devfd);
+    free(tails);
+    free(events);
+    free(threads);
+    free(containers);
+    return 0;
+}
@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pcontainer.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+
+int devfd;
+int iterations = 100000;
+
+// when the last handoff started, only one thread of the container runs at a time.
+long long sent = 0;
+long long handoffs = 0;
+long long total_ns = 0;
+long long min_ns = -1;
+long long max_ns = 0;
+
+static long long now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * account the handoff that just gave the processor to this thread.
+ */
+static void received(void)
+{
+    long long ns;
+
+    if (sent == 0)
+        return;
+    ns = now_ns() - sent;
+    handoffs++;
+    total_ns += ns;
+    if (min_ns < 0 || ns < min_ns)
+        min_ns = ns;
+    if (ns > max_ns)
+        max_ns = ns;
+}
+
+/**
+ * Thread body that joins the container and hands the processor to the other
+ * thread of the container and back, iterations times.
+ */
+void *thread_body(void *x)
+{
+    int i;
+
+    // FIFO so that only the handoffs switch between the two threads.
+    pcontainer_create_policy(devfd, 0, PCONTAINER_POLICY_FIFO);
+    received();
+    for (i = 0; i < iterations; i++)
+    {
+        sent = now_ns();
+        pcontainer_context_switch_handler(devfd, 0);
+        received();
+    }
+    sent = 0;
+    pcontainer_delete(devfd, 0);
+    return NULL;
+}
+
+/**
+ * main function to ping-pong the processor of a container between two threads
+ * and report how long a handoff takes.
+ */
+int main(int argc, char *argv[])
+{
+    pthread_t threads[2];
+    int i;
+
+    if (argc > 1)
+        iterations = atoi(argv[1]);
+
+    // open the kernel module
+    devfd = open("/dev/pcontainer", O_RDWR);
+    if (devfd < 0)
+    {
+        fprintf(stderr, "Device open failed\n");
+        exit(1);
+    }
+    pcontainer_init(devfd);
+
+    for (i = 0; i < 2; i++)
+        pthread_create(&threads[i], NULL, thread_body, NULL);
+    for (i = 0; i < 2; i++)
+        pthread_join(threads[i], NULL);
+
+    if (handoffs == 0)
+    {
+        fprintf(stderr, "No handoff measured\n");
+        exit(1);
+    }
+    printf("Handoffs: %lld, Avg: %lld ns, Min: %lld ns, Max: %lld ns\n",
+           handoffs, total_ns / handoffs, min_ns, max_ns);
+    return 0;
+}
@@ -45,5 +45,93 @@ struct processor_container_cmd
 #define PCONTAINER_IOCTL_DELETE _IOWR('N', 0x45, struct processor_container_cmd)
 #define PCONTAINER_IOCTL_CREATE _IOWR('N', 0x46, struct processor_container_cmd)
 #define PCONTAINER_IOCTL_CSWITCH _IOWR('N', 0x47, struct processor_container_cmd)
+#define PCONTAINER_IOCTL_QUANTUM _IOWR('N', 0x48, struct processor_container_cmd)
+
+/* bounds of a container's time slice in microseconds, see PCONTAINER_IOCTL_QUANTUM */
+#define PCONTAINER_QUANTUM_MIN 50
+#define PCONTAINER_QUANTUM_MAX 1000000
+#define PCONTAINER_IOCTL_WEIGHT _IOWR('N', 0x49, struct processor_container_cmd)
+
+/* share of a container relative to the others, see PCONTAINER_IOCTL_WEIGHT */
+#define PCONTAINER_WEIGHT_DEFAULT 1024
+#define PCONTAINER_WEIGHT_MIN 15
+#define PCONTAINER_WEIGHT_MAX 88761
+#define PCONTAINER_IOCTL_TICKETS _IOWR('N', 0x4a, struct processor_container_cmd)
+
+/* scheduling policy of a new container, passed in op of PCONTAINER_IOCTL_CREATE */
+#define PCONTAINER_POLICY_RR 0 /* time sliced round robin */
+#define PCONTAINER_POLICY_FIFO 1 /* run until yield or delete */
+#define PCONTAINER_POLICY_STRIDE 2 /* slices in proportion to tickets */
+#define PCONTAINER_POLICY_LOTTERY 3 /* slices drawn by tickets */
+#define PCONTAINER_POLICY_MAX 4
+
+/* tickets of a thread under the stride and lottery policies, see PCONTAINER_IOCTL_TICKETS */
+#define PCONTAINER_TICKETS_DEFAULT 100
+#define PCONTAINER_TICKETS_MAX 65536
+#define PCONTAINER_IOCTL_PARALLEL _IOWR('N', 0x4b, struct processor_container_cmd)
+#define PCONTAINER_IOCTL_AFFINITY _IOWR('N', 0x4c, struct processor_container_cmd)
+
+/* most threads of a container running at once, see PCONTAINER_IOCTL_PARALLEL */
+#define PCONTAINER_PARALLEL_MAX 4096
+
+/**
+ * Scheduling counters of the container cid, filled in by
+ * PCONTAINER_IOCTL_STATS. wait[i] counts the times a thread waited
+ * [2^i, 2^(i+1)) ns for a processor of the container, the last bucket
+ * everything longer.
+ */
+#define PCONTAINER_WAIT_BUCKETS 32
+
+struct processor_container_stats
+{
+    __u64 cid;
+    __u64 exec_ns;
+    __u64 switches;
+    __u64 running;
+    __u64 waiting;
+    __u64 max_wait_ns;
+    __u64 wait[PCONTAINER_WAIT_BUCKETS];
+};
+
+#define PCONTAINER_IOCTL_STATS _IOWR('N', 0x4d, struct processor_container_stats)
+
+/**
+ * Scheduler event trace. mmap() of /dev/pcontainer maps, read only, one
+ * segment per possible cpu: a PCONTAINER_TRACE_HEADER byte page holding
+ * struct processor_container_trace_ring, then a ring of
+ * PCONTAINER_TRACE_EVENTS events. Event n of a cpu is in slot
+ * n % PCONTAINER_TRACE_EVENTS and head counts the events ever written, so
+ * a reader that fell more than a ring behind lost the difference. An
+ * event read while head moves closer than a ring past it may have been
+ * overwritten and should be read again or dropped.
+ */
+#define PCONTAINER_TRACE_EVENTS 8192
+#define PCONTAINER_TRACE_HEADER 4096
+
+#define PCONTAINER_EV_CREATE 1 /* pid joined container cid */
+#define PCONTAINER_EV_RUN 2 /* pid was given a processor of cid */
+#define PCONTAINER_EV_WAKE 3 /* pid was woken up to use it */
+#define PCONTAINER_EV_RESUME 4 /* pid woke up and runs */
+#define PCONTAINER_EV_STOP 5 /* pid gave its processor up, yield or quantum */
+#define PCONTAINER_EV_BLOCK 6 /* pid blocked and handed its processor over */
+#define PCONTAINER_EV_DELETE 7 /* pid left cid */
+
+struct processor_container_trace_event
+{
+    __u64 ts; /* CLOCK_MONOTONIC ns */
+    __s32 pid;
+    __s32 cid;
+    __u32 type;
+    __u32 cpu;
+};
+
+struct processor_container_trace_ring
+{
+    __u64 head;
+    __u32 cpu;
+    __u32 nr_cpus; /* segments in the mapping */
+};
+
+#define PCONTAINER_TRACE_SEGMENT (PCONTAINER_TRACE_HEADER + PCONTAINER_TRACE_EVENTS * sizeof(struct processor_container_trace_event))
 
 #endif
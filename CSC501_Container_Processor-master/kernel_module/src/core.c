@@ -47,6 +47,8 @@
 #include <linux/sched.h>
 
 extern struct miscdevice processor_container_dev;
+extern int processor_container_sched_init(void);
+extern void processor_container_sched_exit(void);
 static DEFINE_MUTEX(mutex);
 /**
  * Initialize and register the kernel module
@@ -54,8 +56,13 @@ static DEFINE_MUTEX(mutex);
 int processor_container_init(void)
 {
     int ret;
+    if ((ret = processor_container_sched_init()))
+        return ret;
     if ((ret = misc_register(&processor_container_dev)))
+    {
         printk(KERN_ERR "Unable to register \"processor_container\" misc device\n");
+        processor_container_sched_exit();
+    }
     else
         printk(KERN_ERR "\"processor_container\" misc device installed\n");
     return ret;
@@ -68,4 +75,5 @@ int processor_container_init(void)
 void processor_container_exit(void)
 {
     misc_deregister(&processor_container_dev);
+    processor_container_sched_exit();
 }
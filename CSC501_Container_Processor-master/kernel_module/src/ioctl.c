@@ -46,258 +46,1383 @@
 #include <linux/poll.h>
 #include <linux/mutex.h>
 #include <linux/sched.h>
+#include <linux/capability.h>
 #include <linux/kthread.h>
+#include <linux/list.h>
+#include <linux/hashtable.h>
+#include <linux/hrtimer.h>
+#include <linux/spinlock.h>
+#include <linux/task_work.h>
+#include <linux/kallsyms.h>
+#include <linux/random.h>
+#include <linux/preempt.h>
+#include <linux/irq_work.h>
+#include <linux/log2.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <linux/vmalloc.h>
+#include <linux/profile.h>
 
 
 
+struct container_list;
+struct thread_list;
+
+/**
+ * Scheduling policy of a container. Up to parallel threads of a container
+ * run, the others wait in its run queue; the policy orders the run queue
+ * and picks from it. All of them are called with lock held.
+ *
+ * enqueue   a thread joins the container
+ * dequeue   a waiting thread leaves the container
+ * put_prev  a running thread gives up its processor and waits again
+ * pick_next takes the thread to run next off the run queue, NULL if empty
+ * tick      the quantum of a running thread ran out, returns nonzero to
+ *           preempt it; NULL for policies that never preempt
+ */
+typedef struct sched_policy
+{
+	const char *name;
+	void (*enqueue)(struct container_list *container, struct thread_list *t);
+	void (*dequeue)(struct container_list *container, struct thread_list *t);
+	void (*put_prev)(struct container_list *container, struct thread_list *t);
+	struct thread_list *(*pick_next)(struct container_list *container);
+	int (*tick)(struct container_list *container, struct thread_list *curr);
+}sched_policy;
+
+/**
+ * A thread of a container. It sits either in its container's running list
+ * or in its run queue, and in the threads hash that maps a task straight to
+ * its entry. A running thread that blocks is detached: it gives its
+ * processor to a waiting thread and is in neither list until it is back on
+ * its way to user space and queues again.
+ */
 typedef struct thread_list
 {
-	struct task_struct *thread;
-	struct thread_list* next;
+	struct task_struct *thread; //referenced until the thread leaves
+	struct container_list *container;
+	struct list_head queue; //running list or run queue
+	struct hlist_node node;
+	int running; //holds a processor of the container, set by runnext() to let a waiting thread go
+	int parked; //sleeping in waitturn()
+	int detached;
+	struct callback_head preempt; //queued on the thread when its quantum runs out or it wakes up detached
+	int preempt_pending; //set and cleared atomically, the notifiers cannot take lock
+#ifdef CONFIG_PREEMPT_NOTIFIERS
+	struct preempt_notifier notifier;
+	struct irq_work handoff; //gives the processor away once the scheduler dropped its locks
+#endif
+	u64 charged; //sum_exec_runtime already charged to the container
+	long nice; //nice of the thread before it joined the container
+	long floor; //lowest nice it may run at, its own or what setpriority() would let it set
+	unsigned long tickets; //stride and lottery share
+	u64 stride;
+	u64 pass;
+	unsigned int affinity_gen; //container affinity this thread last applied
+	cpumask_var_t saved; //cpus it had before it joined, given back when it leaves or the container lifts its affinity
+	u64 queued_at; //ns, when it last started waiting for a processor
 }thread_list;
 
+/**
+ * A container. While threads wait for one of its parallel processors its
+ * timer fires every quantum and preempts running threads in favour of
+ * waiting ones.
+ *
+ * Only the running threads of a container are runnable, so the host
+ * scheduler sees at most parallel tasks per container whatever its number
+ * of threads. Giving the container's threads the nice level whose load
+ * weight matches the container's weight, split between the threads that
+ * run at once, makes CFS split the processors between containers in
+ * proportion to their weights. A thread never runs at a nice below its
+ * floor though, the container cannot give it a priority it could not have
+ * taken itself.
+ */
 typedef struct container_list
 {
 	int cid;
-	thread_list* list;
+	struct list_head running; //in the order they started running
+	struct list_head queue; //run queue of waiting threads
+	int nrunning;
+	int nwaiting;
+	int parallel; //most threads running at once
+	struct hrtimer timer;
+	int ticking; //timer is armed
+	u64 quantum; //ns
+	unsigned long weight;
+	long nice; //nice level given to the threads for weight / threads running at once
+	u64 exec_ns; //processor time used by the threads
+	const sched_policy *policy;
+	u64 affinity; //cpus the threads may run on, 0 for all
+	unsigned int affinity_gen;
+	u64 switches; //threads given a processor after waiting
+	u64 max_wait_ns;
+	u64 wait[PCONTAINER_WAIT_BUCKETS]; //log2 histogram of the waits for a processor
 	struct container_list* next;
 }container_list;
 
+#define THREAD_HASH_BITS 10
+
 container_list* head = NULL;
+static DEFINE_HASHTABLE(threads, THREAD_HASH_BITS);
+
+static unsigned int quantum_us = 4000;
+module_param(quantum_us, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(quantum_us, "time slice of a container thread in microseconds");
+
+/**
+ * Containers, run queues and the threads hash. A spinlock since the
+ * container timers take it from interrupt context.
+ */
+static DEFINE_SPINLOCK(lock);
+
+/**
+ * task_work_add() is what lets the timer make the running thread give up the
+ * processor the next time it leaves the kernel, but it is not exported, so
+ * it is looked up at load time. The module refuses to load without it rather
+ * than silently stop time slicing.
+ */
+typedef int (*task_work_add_t)(struct task_struct *task, struct callback_head *work, bool notify);
+typedef struct callback_head *(*task_work_cancel_t)(struct task_struct *task, task_work_func_t func);
+static task_work_add_t do_task_work_add;
+static task_work_cancel_t do_task_work_cancel;
+
+static bool trace = true;
+module_param(trace, bool, S_IRUGO);
+MODULE_PARM_DESC(trace, "record scheduler events in the ring mapped from /dev/pcontainer");
+
+/**
+ * The trace rings, one PCONTAINER_TRACE_SEGMENT per possible cpu, written
+ * only by their own cpu with interrupts off.
+ */
+static void *trace_buf;
+
+
+/***Function traceevent() records a scheduler event in the ring of the current cpu ***/
+static void traceevent(u32 type, struct task_struct *task, int cid)
+{
+	struct processor_container_trace_ring *ring;
+	struct processor_container_trace_event *ev;
+	unsigned long flags;
+	int cpu;
+
+	if(trace_buf == NULL)
+		return;
+	local_irq_save(flags);
+	cpu = smp_processor_id();
+	ring = trace_buf + cpu * PCONTAINER_TRACE_SEGMENT;
+	ev = (void *)ring + PCONTAINER_TRACE_HEADER;
+	ev += ring->head & (PCONTAINER_TRACE_EVENTS - 1);
+	ev->ts = ktime_get_ns();
+	ev->pid = task->pid;
+	ev->cid = cid;
+	ev->type = type;
+	ev->cpu = cpu;
+	smp_wmb(); //the event before the head that publishes it
+	WRITE_ONCE(ring->head, ring->head + 1);
+	local_irq_restore(flags);
+}
+
+
+/**
+ * Load weight of nice levels -20..19 as used by CFS, which keeps its copy
+ * private to the scheduler.
+ */
+static const unsigned long nice_to_weight[40] = {
+ /* -20 */     88761,     71755,     56483,     46273,     36291,
+ /* -15 */     29154,     23254,     18705,     14949,     11916,
+ /* -10 */      9548,      7620,      6100,      4904,      3906,
+ /*  -5 */      3121,      2501,      1991,      1586,      1277,
+ /*   0 */      1024,       820,       655,       526,       423,
+ /*   5 */       335,       272,       215,       172,       137,
+ /*  10 */       110,        87,        70,        56,        45,
+ /*  15 */        36,        29,        23,        18,        15,
+};
+
+
+/***Function weighttonice() returns the nice level whose load weight is closest to the given weight ***/
+static long weighttonice(unsigned long weight)
+{
+	int i;
+
+	for(i = 0; i < 39; i++)
+	{
+		if(weight >= (nice_to_weight[i] + nice_to_weight[i + 1]) / 2)
+			break;
+	}
+	return i + MIN_NICE;
+}
+
+
+/***Function chargethread() adds the processor time the thread used since it was last charged to its container; caller holds lock ***/
+static void chargethread(thread_list *t)
+{
+	container_list *container = t->container;
+	u64 now = t->thread->se.sum_exec_runtime;
+	u64 delta = now - t->charged;
+
+	t->charged = now;
+	container->exec_ns += delta;
+}
+
+
+/***Function nicefloor() returns the lowest nice the calling thread may run at, as setpriority() would allow it ***/
+static long nicefloor(void)
+{
+	unsigned long rlim = min(task_rlimit(current, RLIMIT_NICE), 40UL); //RLIM_INFINITY lets it have any
+	long floor = rlimit_to_nice(rlim);
+
+	if(floor > task_nice(current))
+		floor = task_nice(current); //keeps what it has
+	if(floor > MIN_NICE && capable(CAP_SYS_NICE))
+		floor = MIN_NICE;
+	return floor;
+}
+
+
+/***Function threadnice() returns the nice level the thread runs at in its container; caller holds lock ***/
+static long threadnice(thread_list *t)
+{
+	return max(t->container->nice, t->floor);
+}
 
 
-static DEFINE_MUTEX(mutex);
+/***Function setweight() gives the threads of the container the nice level of its weight split between those that run at once; caller holds lock ***/
+static void setweight(container_list *container)
+{
+	int shares = clamp(container->nrunning + container->nwaiting, 1, container->parallel);
+	long nice = weighttonice(container->weight / shares);
+	thread_list *t;
+	int bkt;
+
+	if(nice == container->nice)
+		return;
+	container->nice = nice;
+	hash_for_each(threads, bkt, t, node) //detached threads are on neither list
+	{
+		if(t->container == container)
+			set_user_nice(t->thread, threadnice(t));
+	}
+}
+
+
+/***Function findthread() returns the entry of the given thread in the threads hash ***/
+thread_list* findthread(struct task_struct *c)
+{
+	thread_list *t;
+
+	hash_for_each_possible(threads, t, node, (unsigned long)c)
+	{
+		if(t->thread == c)
+			return t;
+	}
+	return NULL;
+}
+
+
+/***Function findcid() returns the container with the given id ***/
+container_list* findcid(int cid)
+{
+	container_list *temp;
+
+	for(temp = head; temp != NULL && temp->cid != cid; temp = temp->next)
+		;
+	return temp;
+}
 
 		
 /***Function findcontainer() returns the container to which the given thread belongs ***/
 container_list* findcontainer(struct task_struct *c)
 {
-	
-	container_list *temp = head, *result = NULL;
-	while(temp!=NULL)
+	thread_list *t = findthread(c);
+
+	return t == NULL ? NULL : t->container;
+}
+
+
+/***Pushthreadtoend() moves the given thread to the end of its container's run queue***/
+
+void pushthreadtoend(thread_list *t)
+{
+	list_move_tail(&t->queue, &t->container->queue);
+}
+
+
+/***Functions rr_*() implement round robin, every thread runs a quantum in turn ***/
+static void rr_enqueue(container_list *container, thread_list *t)
+{
+	list_add_tail(&t->queue, &container->queue);
+}
+
+static void rr_dequeue(container_list *container, thread_list *t)
+{
+	list_del(&t->queue);
+}
+
+static void rr_put_prev(container_list *container, thread_list *t)
+{
+	pushthreadtoend(t);
+}
+
+static thread_list* rr_pick_next(container_list *container)
+{
+	thread_list *next = list_first_entry_or_null(&container->queue, thread_list, queue);
+
+	if(next != NULL)
+		list_del(&next->queue);
+	return next;
+}
+
+static int rr_tick(container_list *container, thread_list *curr)
+{
+	return 1;
+}
+
+
+/***Function setstride() derives the stride of a thread from its tickets, the more tickets the smaller the stride ***/
+#define STRIDE1 (1ULL << 20)
+
+static void setstride(thread_list *t)
+{
+	t->stride = div64_u64(STRIDE1, t->tickets);
+}
+
+
+/***Functions stride_*() implement stride scheduling, the thread with the smallest pass runs next ***/
+static void stride_enqueue(container_list *container, thread_list *t)
+{
+	thread_list *temp;
+	u64 pass = 0;
+	int found = 0;
+
+	//join at the current virtual time, not behind it
+	list_for_each_entry(temp, &container->running, queue)
 	{
-		thread_list *threadHead = temp->list;
-		while(threadHead!=NULL)
+		if(!found++ || temp->pass < pass)
+			pass = temp->pass;
+	}
+	list_for_each_entry(temp, &container->queue, queue)
+	{
+		if(!found++ || temp->pass < pass)
+			pass = temp->pass;
+	}
+	setstride(t);
+	t->pass = pass;
+	list_add_tail(&t->queue, &container->queue);
+}
+
+static void stride_put_prev(container_list *container, thread_list *t)
+{
+	t->pass += t->stride;
+	pushthreadtoend(t); //ties go round robin
+}
+
+static thread_list* stride_pick_next(container_list *container)
+{
+	thread_list *temp, *next = NULL;
+
+	list_for_each_entry(temp, &container->queue, queue)
+	{
+		if(next == NULL || temp->pass < next->pass)
+			next = temp;
+	}
+	if(next != NULL)
+		list_del(&next->queue);
+	return next;
+}
+
+
+/***Function lottery_pick_next() draws the thread to run next, each waiting ticket being one chance ***/
+static thread_list* lottery_pick_next(container_list *container)
+{
+	thread_list *temp;
+	unsigned long tickets = 0;
+	u32 winner;
+
+	if(list_empty(&container->queue))
+		return NULL;
+	list_for_each_entry(temp, &container->queue, queue)
+		tickets += temp->tickets;
+	winner = prandom_u32_max(tickets);
+	list_for_each_entry(temp, &container->queue, queue)
+	{
+		if(winner < temp->tickets)
+			break;
+		winner -= temp->tickets;
+	}
+	list_del(&temp->queue);
+	return temp;
+}
+
+
+/**
+ * The policies, indexed by PCONTAINER_POLICY_*. FIFO shares round robin's
+ * queue but has no tick, a thread runs until it yields or leaves.
+ */
+static const sched_policy policies[PCONTAINER_POLICY_MAX] = {
+	[PCONTAINER_POLICY_RR] = { "rr", rr_enqueue, rr_dequeue, rr_put_prev, rr_pick_next, rr_tick },
+	[PCONTAINER_POLICY_FIFO] = { "fifo", rr_enqueue, rr_dequeue, rr_put_prev, rr_pick_next, NULL },
+	[PCONTAINER_POLICY_STRIDE] = { "stride", stride_enqueue, rr_dequeue, stride_put_prev, stride_pick_next, rr_tick },
+	[PCONTAINER_POLICY_LOTTERY] = { "lottery", rr_enqueue, rr_dequeue, rr_put_prev, lottery_pick_next, rr_tick },
+};
+
+
+/***Function queuepreempt() makes the thread call preempt_thread() the next time it returns to user space ***/
+static void queuepreempt(thread_list *t)
+{
+	if(cmpxchg(&t->preempt_pending, 0, 1) != 0)
+		return;
+	if(do_task_work_add(t->thread, &t->preempt, true) == 0)
+		kick_process(t->thread); //get it into the kernel now if it runs on another cpu
+	else
+		t->preempt_pending = 0;
+}
+
+
+/***Function contended() tells whether running threads of the container have to make room; caller holds lock ***/
+static int contended(container_list *container)
+{
+	return container->nwaiting > 0 || container->nrunning > container->parallel;
+}
+
+
+/***Function starttimer() arms the container's timer once a thread waits for a processor; caller holds lock ***/
+static void starttimer(container_list *container)
+{
+	if(container->ticking || container->policy->tick == NULL || !contended(container))
+		return;
+	container->ticking = 1;
+	hrtimer_start(&container->timer, ns_to_ktime(container->quantum), HRTIMER_MODE_REL);
+}
+
+
+/***Function container_tick() runs every quantum and preempts as many running threads as there are threads waiting ***/
+static enum hrtimer_restart container_tick(struct hrtimer *timer)
+{
+	container_list *container = container_of(timer, container_list, timer);
+	thread_list *t;
+	unsigned long flags;
+	int preempt;
+
+	spin_lock_irqsave(&lock, flags);
+	if(!contended(container))
+	{
+		container->ticking = 0;
+		spin_unlock_irqrestore(&lock, flags);
+		return HRTIMER_NORESTART;
+	}
+	preempt = container->nwaiting + max(container->nrunning - container->parallel, 0);
+	list_for_each_entry(t, &container->running, queue) //longest running first
+	{
+		chargethread(t);
+		if(preempt == 0 || !container->policy->tick(container, t))
+			continue;
+		preempt--;
+		queuepreempt(t);
+	}
+	hrtimer_forward_now(timer, ns_to_ktime(container->quantum));
+	spin_unlock_irqrestore(&lock, flags);
+	return HRTIMER_RESTART;
+}
+
+
+/***Function waited() counts a thread that waited the given time for a processor of the container; caller holds lock ***/
+static void waited(container_list *container, u64 ns)
+{
+	int bucket = ns < 2 ? 0 : ilog2(ns);
+
+	container->switches++;
+	if(ns > container->max_wait_ns)
+		container->max_wait_ns = ns;
+	container->wait[min(bucket, PCONTAINER_WAIT_BUCKETS - 1)]++;
+}
+
+
+/***Function runnext() lets the next waiting thread run if the container has a processor to spare; caller holds lock ***/
+static thread_list* runnext(container_list *container)
+{
+	thread_list *next;
+
+	if(container->nrunning >= container->parallel)
+		return NULL;
+	next = container->policy->pick_next(container);
+	if(next == NULL)
+		return NULL;
+	waited(container, ktime_get_ns() - next->queued_at);
+	container->nwaiting--;
+	list_add_tail(&next->queue, &container->running);
+	container->nrunning++;
+	next->running = 1;
+	traceevent(PCONTAINER_EV_RUN, next->thread, container->cid);
+	return next;
+}
+
+
+/***Function wakethread() wakes up a thread runnext() gave a processor to ***/
+static void wakethread(thread_list *t)
+{
+	traceevent(PCONTAINER_EV_WAKE, t->thread, t->container->cid);
+	wake_up_process(t->thread);
+}
+
+
+/***Function stopthread() takes a running thread off the running list; caller holds lock ***/
+static void stopthread(thread_list *t)
+{
+	list_del_init(&t->queue); //a detached thread is put back with put_prev()
+	t->container->nrunning--;
+	t->running = 0;
+}
+
+
+/***Function applyaffinity() moves the calling thread onto the cpus its container allows ***/
+static void applyaffinity(thread_list *t)
+{
+	cpumask_var_t mask;
+	unsigned long flags;
+	u64 affinity;
+	unsigned int gen;
+	int cpu;
+
+	spin_lock_irqsave(&lock, flags);
+	affinity = t->container->affinity;
+	gen = t->container->affinity_gen;
+	spin_unlock_irqrestore(&lock, flags);
+	if(gen == t->affinity_gen || !alloc_cpumask_var(&mask, GFP_KERNEL))
+		return;
+	if(affinity == 0)
+		cpumask_copy(mask, t->saved);
+	else
+	{
+		cpumask_clear(mask);
+		for(cpu = 0; cpu < 64 && cpu < nr_cpu_ids; cpu++)
 		{
-			if(threadHead->thread == c)
-			{
-				result = temp;
-				return result;
-			}
-			threadHead = threadHead->next;
+			if(affinity & (1ULL << cpu))
+				cpumask_set_cpu(cpu, mask);
 		}
-		temp = temp->next;
 	}
-	return NULL;
+	if(set_cpus_allowed_ptr(current, mask) == 0)
+		t->affinity_gen = gen;
+	free_cpumask_var(mask);
 }
 
 
 /**
- * Delete the task in the container.
- * 
- * external functions needed:
- * mutex_lock(), mutex_unlock(), wake_up_process(), 
+ * Waiting threads sleep in waitturn() until runnext() grants them a
+ * processor by setting running, so a wakeup that comes before the sleep or
+ * one from somewhere else cannot make a thread run out of turn. They do not
+ * count as load and do not trip the hung task check, but can be killed.
  */
+#define TASK_TURN (TASK_KILLABLE | TASK_NOLOAD)
 
+int processor_container_delete(struct processor_container_cmd __user *user_cmd);
 
-int processor_container_delete(struct processor_container_cmd __user *user_cmd)
-{
-	mutex_lock(&mutex);  
-	container_list *container = NULL;
-	container_list *temp = head;
-	container_list *temporary = NULL;
-	thread_list *thead = NULL;
-	int flag =0;
 
-	container = findcontainer(current);
-	printk("\nEntering delete Pid: %d Tgid: %d Container ID: %d", current->pid, current->tgid, container->cid);
+/***Function waitturn() sleeps until the thread is granted a processor of its container, -EINTR if it gets killed first ***/
+static int waitturn(thread_list *t)
+{
+	int ret = 0;
 
-	while(temp!=NULL)
+	t->parked = 1; //not a thread that blocked with a processor, see thread_sched_out()
+	for(;;)
 	{
-		if(temp->cid == container->cid)
+		set_current_state(TASK_TURN);
+		if(READ_ONCE(t->running))
 		{
-			thead = temp->list;
-			temp->list = thead->next;
-			kfree(thead); //free memory holding the thread
-			thead = NULL;
-			if(temp->list == NULL)
-			{
-				if(temp == head)
-				{
-					head = head->next;
-				}
-				else
-				{
-					temporary->next = temp->next;
-				}
-				kfree(temp); //free memory holding the container given no of threads=0
-				temp = NULL;
-				flag = 1;
-			}
+			traceevent(PCONTAINER_EV_RESUME, current, t->container->cid);
 			break;
 		}
-		temporary = temp;
-		temp = temp->next;	
+		if(fatal_signal_pending(current))
+		{
+			ret = -EINTR;
+			break;
+		}
+		schedule();
 	}
+	__set_current_state(TASK_RUNNING);
+	t->parked = 0;
+	return ret;
+}
 
-	mutex_unlock(&mutex);
-	if(flag == 0)
+
+/***Function yieldthread() gives the processor of the thread to the next thread waiting in its container***/
+static void yieldthread(thread_list *t)
+{
+	container_list *container = t->container;
+	thread_list *next;
+	struct task_struct *task = NULL;
+	unsigned long flags;
+
+	spin_lock_irqsave(&lock, flags);
+	if(t->detached) //blocked and gave its processor away, wait for one again
+		t->detached = 0;
+	else if(!t->running || !contended(container))
 	{
-		printk("\nDeleting thread %d from container %d and waking up %d", current->pid, container->cid, temp->list->thread->pid);
-		wake_up_process(temp->list->thread);  // Waking up next thread in the container's thread queue
+		spin_unlock_irqrestore(&lock, flags);
+		return;
 	}
-	
-	
+	else
+	{
+		stopthread(t);
+		traceevent(PCONTAINER_EV_STOP, current, container->cid);
+	}
+	chargethread(t);
+	t->queued_at = ktime_get_ns();
+	container->policy->put_prev(container, t);
+	container->nwaiting++;
+	next = runnext(container);
+	if(next != NULL && next != t)
+	{
+		task = next->thread;
+		get_task_struct(task); //it may leave as soon as it runs
+	}
+	spin_unlock_irqrestore(&lock, flags);
+	if(next == t)
+		return;
+	if(task != NULL)
+	{
+		wakethread(next); //waking up next thread in the queue, it runs in our place
+		t->parked = 1;
+		set_current_state(TASK_TURN);
+		yield_to(task, true); //switches straight to it as we go to sleep, unless it already runs elsewhere
+		put_task_struct(task);
+	}
+	if(waitturn(t) != 0)
+	{
+		processor_container_delete(NULL); //killed while waiting, leave rather than hold up the queue
+		return;
+	}
+	applyaffinity(t);
+}
 
-	return 0;
+
+/***Function preempt_thread() runs in a thread on its way back to user space after its quantum ran out or it woke up detached ***/
+static void preempt_thread(struct callback_head *work)
+{
+	thread_list *t = container_of(work, thread_list, preempt);
+
+	xchg(&t->preempt_pending, 0);
+	if(current->flags & PF_EXITING) //run from exit_task_work(), the thread is not coming back
+	{
+		processor_container_delete(NULL);
+		return;
+	}
+	applyaffinity(t);
+	yieldthread(t);
 }
 
 
-/***Pushthreadtoend() appends running thread at the end of the container's thread queue***/
+#ifdef CONFIG_PREEMPT_NOTIFIERS
+/***Function handoff_thread() detaches a running thread that blocked and lets a waiting thread have its processor ***/
+static void handoff_thread(struct irq_work *work)
+{
+	thread_list *t = container_of(work, thread_list, handoff);
+	container_list *container = t->container;
+	thread_list *next = NULL;
+	unsigned long flags;
+
+	spin_lock_irqsave(&lock, flags);
+	if(t->running && container->nwaiting > 0 && READ_ONCE(t->thread->state) != TASK_RUNNING)
+	{
+		chargethread(t);
+		stopthread(t);
+		t->detached = 1;
+		traceevent(PCONTAINER_EV_BLOCK, t->thread, container->cid);
+		next = runnext(container);
+		smp_mb(); //pairs with the wakeup setting TASK_RUNNING before thread_sched_in() looks at detached
+		if(READ_ONCE(t->thread->state) == TASK_RUNNING) //woke up already, thread_sched_in() may have missed detached
+			queuepreempt(t);
+	}
+	spin_unlock_irqrestore(&lock, flags);
+	if(next != NULL)
+		wakethread(next);
+}
+
 
-void pushthreadtoend(int cid)
+/***Function thread_sched_out() is called by the scheduler, with its locks held, whenever the thread stops running ***/
+static void thread_sched_out(struct preempt_notifier *notifier, struct task_struct *next)
 {
-	container_list *temp = head;
-	thread_list *threadHead=NULL;
-	if(temp!=NULL)
+	thread_list *t = container_of(notifier, thread_list, notifier);
+
+	//blocking rather than preempted, and not waiting for a processor in waitturn()
+	if(READ_ONCE(t->running) && !t->parked && current->state != TASK_RUNNING)
+		irq_work_queue(&t->handoff);
+}
+
+
+/***Function thread_sched_in() is called by the scheduler, with its locks held, whenever the thread starts running ***/
+static void thread_sched_in(struct preempt_notifier *notifier, int cpu)
+{
+	thread_list *t = container_of(notifier, thread_list, notifier);
+
+	if(READ_ONCE(t->detached))
+		queuepreempt(t); //queue again for a processor before running user code
+}
+
+
+static struct preempt_ops thread_preempt_ops = {
+	.sched_in = thread_sched_in,
+	.sched_out = thread_sched_out,
+};
+#endif
+
+
+/**
+ * Delete the task in the container.
+ * 
+ * external functions needed:
+ * spin_lock(), spin_unlock(), wake_up_process(), 
+ */
+
+
+int processor_container_delete(struct processor_container_cmd __user *user_cmd)
+{
+	unsigned long flags;
+	container_list *container = NULL;
+	container_list *temp = NULL;
+	container_list *temporary = NULL;
+	thread_list *thead, *next = NULL;
+
+	spin_lock_irqsave(&lock, flags);
+	thead = findthread(current);
+	if(thead == NULL)
+	{
+		spin_unlock_irqrestore(&lock, flags);
+		return -EINVAL;
+	}
+	container = thead->container;
+	traceevent(PCONTAINER_EV_DELETE, current, container->cid);
+
+	chargethread(thead);
+	//only a running thread gives its processor to the next one
+	if(thead->running)
+	{
+		stopthread(thead);
+		next = runnext(container);
+	}
+	else if(!thead->detached)
+	{
+		container->policy->dequeue(container, thead);
+		container->nwaiting--;
+	}
+	hash_del(&thead->node); //off the run queue, the timer can no longer queue a preemption on it
+	if(container->nrunning == 0 && container->nwaiting == 0)
 	{
-		while(temp!=NULL)
+		temp = head;
+		while(temp != container)
+		{
+			temporary = temp;
+			temp = temp->next;
+		}
+		if(temp == head)
 		{
-			if(temp->cid == cid)
-			{
-				threadHead=temp->list;
-				break;
-			}
-			temp = temp->next;	
+			head = head->next;
+		}
+		else
+		{
+			temporary->next = temp->next;
 		}
 	}
-        
-	//no action is performed if corresponding container's thread queue is empty or has only one thread  
-	if(threadHead==NULL || threadHead->next==NULL)
+	else
+		setweight(container); //the weight is split between fewer threads
+
+	spin_unlock_irqrestore(&lock, flags);
+#ifdef CONFIG_PREEMPT_NOTIFIERS
+	preempt_notifier_unregister(&thead->notifier);
+	irq_work_sync(&thead->handoff);
+#endif
+	do_task_work_cancel(current, preempt_thread); //a preemption still queued on us would run after thead is gone
+	set_user_nice(current, thead->nice);
+	if(thead->affinity_gen != 0) //the container moved us
+		set_cpus_allowed_ptr(current, thead->saved);
+	free_cpumask_var(thead->saved);
+	put_task_struct(thead->thread);
+	kfree(thead); //free memory holding the thread
+	thead = NULL;
+	if(temp != NULL)
 	{
-		return;
+		hrtimer_cancel(&temp->timer); //waits for a tick running on another cpu
+		kfree(temp); //free memory holding the container given no of threads=0
+		temp = NULL;
 	}
+	if(next != NULL)
+	{
+		wakethread(next);  // Waking up next thread in the container's thread queue
+	}
+	
+	
 
-	thread_list *newThreadHead = threadHead->next;
-	thread_list *node=threadHead;
-
-	while(node->next!=NULL)
-		node=node->next; 
-	node->next=threadHead;
-	threadHead->next=NULL;
-	temp->list=newThreadHead;
+	return 0;
 }
 
+
 /**
- * Create a task in the corresponding container.
+ * Create a task in the corresponding container. A new container is scheduled
+ * by the PCONTAINER_POLICY_* in cmd.op, joining an existing one keeps the
+ * policy it was created with. A thread that already is in a container gets
+ * -EBUSY.
  * external functions needed:
- * copy_from_user(), mutex_lock(), mutex_unlock(), set_current_state(), schedule()
+ * copy_from_user(), spin_lock(), spin_unlock(), set_current_state(), schedule()
  * 
  * external variables needed:
  * struct task_struct* current  
  */
 int processor_container_create(struct processor_container_cmd __user *user_cmd)
 {
-	mutex_lock(&mutex);
+	unsigned long flags;
 	int container_id;
 	int flag=0;
 	struct processor_container_cmd container;
-	copy_from_user(&container,user_cmd, sizeof(container)); //fetch container Id from user space
+	container_list *temp, *t = NULL, *new;
+	thread_list *thead;
+	if(copy_from_user(&container,user_cmd, sizeof(container))) //fetch container Id from user space
+		return -EFAULT;
 	container_id = (int)container.cid;
-	printk("\nEntering create Pid: %d Tgid: %d Container ID: %d", current->pid, current->tgid, container_id);
-	if(head == NULL) //create new container if no container exists
-	{
-		head = (container_list *)kmalloc(sizeof(container_list), GFP_KERNEL); //initialize container list
-		head->cid = container_id;
-		head->next = NULL;
-		thread_list *thead = (thread_list *)kmalloc(sizeof(thread_list), GFP_KERNEL);// initialize container's thread list
-		thead->next = NULL;
-		thead->thread = current;
-		head->list = thead;
-	}
-	else 
-	{
-		container_list *temp = head, *t = NULL;		
-		while(temp!=NULL)
-		{		
-			if(temp->cid == container_id)
-			{
-				thread_list *thead = temp->list;
-				flag=1;
-				while(thead->next!=NULL)
-					thead=thead->next;
-				thread_list *new = (thread_list *)kmalloc(sizeof(thread_list), GFP_KERNEL); 
-				new->next = NULL;
-				new->thread = current; 
-				thead->next = new; //append thread to an existing container
-				break;
-			}
-			t = temp;
-			temp = temp->next;
-		}
-		if(temp==NULL) //creating a new container and appending it to container list
-		{
-			container_list *new = (container_list *)kmalloc(sizeof(container_list), GFP_KERNEL);
-			new->cid = container_id;
-			new->next = NULL;
-			thread_list *thead = (thread_list *)kmalloc(sizeof(thread_list), GFP_KERNEL);
-			thead->next = NULL;
-			thead->thread = current;
-			new->list = thead;
-			t->next = new;
-		}
+	if(container.op >= PCONTAINER_POLICY_MAX)
+		return -EINVAL;
+	thead = (thread_list *)kmalloc(sizeof(thread_list), GFP_KERNEL);
+	new = (container_list *)kmalloc(sizeof(container_list), GFP_KERNEL); //used if the container does not exist yet
+	if(thead == NULL || new == NULL || !alloc_cpumask_var(&thead->saved, GFP_KERNEL))
+	{
+		kfree(thead);
+		kfree(new);
+		return -ENOMEM;
 	}
+	thead->thread = current;
+	get_task_struct(current);
+	thead->running = 0;
+	thead->parked = 0;
+	thead->detached = 0;
+	thead->preempt_pending = 0;
+	thead->charged = current->se.sum_exec_runtime;
+	thead->nice = task_nice(current);
+	thead->floor = nicefloor();
+	thead->tickets = PCONTAINER_TICKETS_DEFAULT;
+	thead->stride = 0;
+	thead->pass = 0;
+	thead->affinity_gen = 0;
+	cpumask_copy(thead->saved, tsk_cpus_allowed(current));
+	init_task_work(&thead->preempt, preempt_thread);
+#ifdef CONFIG_PREEMPT_NOTIFIERS
+	init_irq_work(&thead->handoff, handoff_thread);
+	preempt_notifier_init(&thead->notifier, &thread_preempt_ops);
+#endif
+	spin_lock_irqsave(&lock, flags);
+	if(findthread(current) != NULL) //a thread is in one container at a time, it deletes itself to move
+	{
+		spin_unlock_irqrestore(&lock, flags);
+		put_task_struct(current);
+		free_cpumask_var(thead->saved);
+		kfree(thead);
+		kfree(new);
+		return -EBUSY;
+	}
+	temp = findcid(container_id);
+	if(temp==NULL) //creating a new container and appending it to container list
+	{
+		for(t = head; t != NULL && t->next != NULL; t = t->next)
+			;
+		temp = new;
+		new = NULL;
+		temp->cid = container_id;
+		temp->next = NULL;
+		INIT_LIST_HEAD(&temp->running);
+		INIT_LIST_HEAD(&temp->queue);
+		temp->nrunning = 0;
+		temp->nwaiting = 0;
+		temp->parallel = 1;
+		hrtimer_init(&temp->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+		temp->timer.function = container_tick;
+		temp->ticking = 0;
+		temp->quantum = (u64)quantum_us * NSEC_PER_USEC;
+		temp->weight = PCONTAINER_WEIGHT_DEFAULT;
+		temp->nice = 0;
+		temp->exec_ns = 0;
+		temp->policy = &policies[container.op];
+		temp->affinity = 0;
+		temp->affinity_gen = 0;
+		temp->switches = 0;
+		temp->max_wait_ns = 0;
+		memset(temp->wait, 0, sizeof(temp->wait));
+		if(t == NULL)
+			head = temp;
+		else
+			t->next = temp;
+	}
+	thead->container = temp;
+	thead->queued_at = ktime_get_ns();
+	traceevent(PCONTAINER_EV_CREATE, current, container_id);
+	temp->policy->enqueue(temp, thead); //add thread to the container's run queue
+	temp->nwaiting++;
+	hash_add(threads, &thead->node, (unsigned long)current);
+	if(runnext(temp) != thead)
+		flag = 1; //all processors of the container are taken, the run queue only ever holds threads then
+	starttimer(temp);
+	setweight(temp);
+	set_user_nice(current, threadnice(thead));
 
-	mutex_unlock(&mutex);
+	spin_unlock_irqrestore(&lock, flags);
+	kfree(new);
+#ifdef CONFIG_PREEMPT_NOTIFIERS
+	preempt_disable(); //the notifier list is only touched by the thread itself with preemption off
+	preempt_notifier_register(&thead->notifier);
+	preempt_enable();
+#endif
 	if(flag == 1)
 	{
-
-		printk("\nPutting thread %d to sleep",current->pid);
-		set_current_state(TASK_INTERRUPTIBLE);
-		schedule();
+		if(waitturn(thead) != 0)
+		{
+			processor_container_delete(NULL);
+			return -EINTR;
+		}
 	}
+	applyaffinity(thead);
 
     return 0;
 }
 
 
-
-
 /**
- * switch to the next task within the same container
+ * switch to the next task within the same container. Time slicing is done
+ * by the container timers; this is a voluntary yield.
  * 
  * external functions needed:
- * mutex_lock(), mutex_unlock(), wake_up_process(), set_current_state(), schedule()
+ * spin_lock(), spin_unlock(), wake_up_process(), set_current_state(), schedule()
  */
 /***processor_container_switch() implements Round Robin scheduling within the threads assigned to the same container***/
 int processor_container_switch(struct processor_container_cmd __user *user_cmd)
 {
+	thread_list *t;
+	unsigned long flags;
 	if(current->pid==current->tgid) //ignore switch call for benchmark process
 		return 0;
-	mutex_lock(&mutex);
-	printk("\nEntering switch Pid: %d Tgid: %d ", current->pid, current->tgid);
-	container_list *container = findcontainer(current);
-	if(container==NULL)
-	{
-		mutex_unlock(&mutex);
-		printk("\nNo switch as there is only one thread in the container");
+	spin_lock_irqsave(&lock, flags);
+	t = findthread(current);
+	spin_unlock_irqrestore(&lock, flags);
+	if(t==NULL)
 		return 0;
-	}
-	printk("Container ID: %d",container->cid);
-	pushthreadtoend(container->cid);
-	mutex_unlock(&mutex);
-	if(container->list->next!=NULL)
-	{       
-                printk("\nSwitching from %d to %d",current->pid,container->list->thread->pid);
-		wake_up_process(container->list->thread); //waking up next thread in the queue
-		set_current_state(TASK_INTERRUPTIBLE); //sleeping the current thread
-		schedule();
-	}
+	yieldthread(t);
 	
     return 0;
 }
 
 
+/**
+ * Set the time slice of a container's threads to cmd.op microseconds, or back
+ * to the quantum_us default when cmd.op is 0. A running slice is cut short or
+ * stretched to the new length.
+ *
+ * external functions needed:
+ * copy_from_user(), spin_lock(), spin_unlock(), hrtimer_start()
+ */
+int processor_container_quantum(struct processor_container_cmd __user *user_cmd)
+{
+	struct processor_container_cmd cmd;
+	container_list *container;
+	unsigned long flags;
+	u64 quantum;
+
+	if(copy_from_user(&cmd, user_cmd, sizeof(cmd)))
+		return -EFAULT;
+	quantum = cmd.op == 0 ? quantum_us : cmd.op;
+	if(quantum < PCONTAINER_QUANTUM_MIN || quantum > PCONTAINER_QUANTUM_MAX)
+		return -EINVAL;
+	spin_lock_irqsave(&lock, flags);
+	container = findcid((int)cmd.cid);
+	if(container == NULL)
+	{
+		spin_unlock_irqrestore(&lock, flags);
+		return -EINVAL;
+	}
+	container->quantum = quantum * NSEC_PER_USEC;
+	if(container->ticking)
+		hrtimer_start(&container->timer, ns_to_ktime(container->quantum), HRTIMER_MODE_REL);
+	spin_unlock_irqrestore(&lock, flags);
+	return 0;
+}
+
+
+/**
+ * Set the weight of the caller's container cmd.cid to cmd.op, or back to
+ * PCONTAINER_WEIGHT_DEFAULT when cmd.op is 0. Containers get processor time
+ * in proportion to their weights, as far as their threads may raise their
+ * priority: a weight above the default needs CAP_SYS_NICE or RLIMIT_NICE.
+ *
+ * external functions needed:
+ * copy_from_user(), spin_lock(), spin_unlock(), set_user_nice()
+ */
+int processor_container_weight(struct processor_container_cmd __user *user_cmd)
+{
+	struct processor_container_cmd cmd;
+	container_list *container;
+	thread_list *t;
+	unsigned long flags;
+	unsigned long weight;
+
+	if(copy_from_user(&cmd, user_cmd, sizeof(cmd)))
+		return -EFAULT;
+	weight = cmd.op == 0 ? PCONTAINER_WEIGHT_DEFAULT : cmd.op;
+	if(weight < PCONTAINER_WEIGHT_MIN || weight > PCONTAINER_WEIGHT_MAX)
+		return -EINVAL;
+	spin_lock_irqsave(&lock, flags);
+	container = findcid((int)cmd.cid);
+	if(container == NULL)
+	{
+		spin_unlock_irqrestore(&lock, flags);
+		return -EINVAL;
+	}
+	t = findthread(current);
+	if(t == NULL || t->container != container) //only its own threads weigh a container
+	{
+		spin_unlock_irqrestore(&lock, flags);
+		return -EPERM;
+	}
+	container->weight = weight;
+	setweight(container);
+	spin_unlock_irqrestore(&lock, flags);
+	return 0;
+}
+
+
+/**
+ * Give the calling thread cmd.op tickets, or PCONTAINER_TICKETS_DEFAULT when
+ * cmd.op is 0. Under the stride and lottery policies threads get processor
+ * time in proportion to their tickets.
+ *
+ * external functions needed:
+ * copy_from_user(), spin_lock(), spin_unlock()
+ */
+int processor_container_tickets(struct processor_container_cmd __user *user_cmd)
+{
+	struct processor_container_cmd cmd;
+	thread_list *t;
+	unsigned long flags;
+	unsigned long tickets;
+
+	if(copy_from_user(&cmd, user_cmd, sizeof(cmd)))
+		return -EFAULT;
+	tickets = cmd.op == 0 ? PCONTAINER_TICKETS_DEFAULT : cmd.op;
+	if(tickets > PCONTAINER_TICKETS_MAX)
+		return -EINVAL;
+	spin_lock_irqsave(&lock, flags);
+	t = findthread(current);
+	if(t == NULL)
+	{
+		spin_unlock_irqrestore(&lock, flags);
+		return -EINVAL;
+	}
+	t->tickets = tickets;
+	setstride(t);
+	spin_unlock_irqrestore(&lock, flags);
+	return 0;
+}
+
+
+/**
+ * Let up to cmd.op threads of a container run at the same time, or one when
+ * cmd.op is 0. Waiting threads start running at once when the limit rises,
+ * running ones make room at their next quantum when it falls.
+ * The container's weight is split between the threads that run at once,
+ * so it keeps its share whatever the limit.
+ *
+ * external functions needed:
+ * copy_from_user(), spin_lock(), spin_unlock(), wake_up_process()
+ */
+int processor_container_parallel(struct processor_container_cmd __user *user_cmd)
+{
+	struct processor_container_cmd cmd;
+	container_list *container;
+	thread_list *t;
+	unsigned long flags;
+
+	if(copy_from_user(&cmd, user_cmd, sizeof(cmd)))
+		return -EFAULT;
+	if(cmd.op > PCONTAINER_PARALLEL_MAX)
+		return -EINVAL;
+	spin_lock_irqsave(&lock, flags);
+	container = findcid((int)cmd.cid);
+	if(container == NULL)
+	{
+		spin_unlock_irqrestore(&lock, flags);
+		return -EINVAL;
+	}
+	container->parallel = cmd.op == 0 ? 1 : cmd.op;
+	while((t = runnext(container)) != NULL)
+		wakethread(t);
+	starttimer(container);
+	setweight(container); //the weight is split between as many threads as run at once
+	spin_unlock_irqrestore(&lock, flags);
+	return 0;
+}
+
+
+/**
+ * Keep the threads of a container on the cpus whose bits are set in cmd.op,
+ * cpu 0 being the lowest bit, or let them run anywhere when cmd.op is 0.
+ * Each thread moves itself the next time it is switched or preempted.
+ *
+ * external functions needed:
+ * copy_from_user(), spin_lock(), spin_unlock()
+ */
+int processor_container_affinity(struct processor_container_cmd __user *user_cmd)
+{
+	struct processor_container_cmd cmd;
+	container_list *container;
+	thread_list *t;
+	unsigned long flags;
+	int cpu, online = 0;
+
+	if(copy_from_user(&cmd, user_cmd, sizeof(cmd)))
+		return -EFAULT;
+	for(cpu = 0; cpu < 64 && cpu < nr_cpu_ids; cpu++)
+	{
+		if((cmd.op & (1ULL << cpu)) && cpu_online(cpu))
+			online = 1;
+	}
+	if(cmd.op != 0 && !online)
+		return -EINVAL;
+	spin_lock_irqsave(&lock, flags);
+	container = findcid((int)cmd.cid);
+	if(container == NULL)
+	{
+		spin_unlock_irqrestore(&lock, flags);
+		return -EINVAL;
+	}
+	container->affinity = cmd.op;
+	if(++container->affinity_gen == 0) //0 is what threads start with
+		container->affinity_gen = 1;
+	list_for_each_entry(t, &container->running, queue) //waiting threads move when they wake up
+		queuepreempt(t);
+	spin_unlock_irqrestore(&lock, flags);
+	return 0;
+}
+
+
+/***Function fillstats() copies the counters of a container, charging its running threads first; caller holds lock ***/
+static void fillstats(container_list *container, struct processor_container_stats *stats)
+{
+	thread_list *t;
+
+	list_for_each_entry(t, &container->running, queue)
+		chargethread(t);
+	stats->cid = container->cid;
+	stats->exec_ns = container->exec_ns;
+	stats->switches = container->switches;
+	stats->running = container->nrunning;
+	stats->waiting = container->nwaiting;
+	stats->max_wait_ns = container->max_wait_ns;
+	memcpy(stats->wait, container->wait, sizeof(stats->wait));
+}
+
+
+/**
+ * Report the scheduling counters of the container stats.cid.
+ *
+ * external functions needed:
+ * copy_from_user(), copy_to_user(), spin_lock(), spin_unlock()
+ */
+int processor_container_stats(struct processor_container_stats __user *user_stats)
+{
+	struct processor_container_stats stats;
+	container_list *container;
+	unsigned long flags;
+
+	if(copy_from_user(&stats.cid, &user_stats->cid, sizeof(stats.cid)))
+		return -EFAULT;
+	spin_lock_irqsave(&lock, flags);
+	container = findcid((int)stats.cid);
+	if(container == NULL)
+	{
+		spin_unlock_irqrestore(&lock, flags);
+		return -EINVAL;
+	}
+	fillstats(container, &stats);
+	spin_unlock_irqrestore(&lock, flags);
+	if(copy_to_user(user_stats, &stats, sizeof(stats)))
+		return -EFAULT;
+	return 0;
+}
+
+
+/**
+ * What /proc/pcontainer shows of a container, copied under lock and
+ * formatted once it is dropped.
+ */
+typedef struct container_row
+{
+	struct processor_container_stats stats;
+	const char *policy;
+	int parallel;
+	u64 quantum_us;
+	unsigned long weight;
+}container_row;
+
+
+/**
+ * /proc/pcontainer, one line per container:
+ * cid policy parallel running waiting quantum_us weight exec_ns switches max_wait_ns wait[0] .. wait[31]
+ */
+static int processor_container_show(struct seq_file *m, void *v)
+{
+	container_row *rows = NULL;
+	container_list *temp;
+	unsigned long flags;
+	int count = 0, n, i, j;
+
+	for(;;) //rows are allocated with lock dropped, count again until there are enough
+	{
+		spin_lock_irqsave(&lock, flags);
+		for(n = 0, temp = head; temp != NULL; temp = temp->next)
+			n++;
+		if(n <= count)
+			break;
+		spin_unlock_irqrestore(&lock, flags);
+		kfree(rows);
+		count = n + 8; //room for containers created meanwhile
+		rows = kmalloc_array(count, sizeof(container_row), GFP_KERNEL);
+		if(rows == NULL)
+			return -ENOMEM;
+	}
+	for(n = 0, temp = head; temp != NULL; temp = temp->next, n++)
+	{
+		fillstats(temp, &rows[n].stats);
+		rows[n].policy = temp->policy->name;
+		rows[n].parallel = temp->parallel;
+		rows[n].quantum_us = div64_u64(temp->quantum, NSEC_PER_USEC);
+		rows[n].weight = temp->weight;
+	}
+	spin_unlock_irqrestore(&lock, flags);
+	for(i = 0; i < n; i++)
+	{
+		seq_printf(m, "%d %s %d %llu %llu %llu %lu %llu %llu %llu", (int)rows[i].stats.cid, rows[i].policy,
+			rows[i].parallel, rows[i].stats.running, rows[i].stats.waiting, rows[i].quantum_us,
+			rows[i].weight, rows[i].stats.exec_ns, rows[i].stats.switches, rows[i].stats.max_wait_ns);
+		for(j = 0; j < PCONTAINER_WAIT_BUCKETS; j++)
+			seq_printf(m, " %llu", rows[i].stats.wait[j]);
+		seq_putc(m, '\n');
+	}
+	kfree(rows);
+	return 0;
+}
+
+static int processor_container_proc_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, processor_container_show, NULL);
+}
+
+static const struct file_operations processor_container_proc_fops = {
+	.owner = THIS_MODULE,
+	.open = processor_container_proc_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+
+/**
+ * Map the trace rings read only into the caller.
+ *
+ * external functions needed:
+ * remap_vmalloc_range()
+ */
+int processor_container_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+	if(trace_buf == NULL)
+		return -ENODEV;
+	if(vma->vm_flags & VM_WRITE)
+		return -EPERM;
+	vma->vm_flags &= ~VM_MAYWRITE;
+	return remap_vmalloc_range(vma, trace_buf, vma->vm_pgoff);
+}
+
+
+/***Function task_exiting() takes a thread out of its container when it exits without deleting itself ***/
+static int task_exiting(struct notifier_block *nb, unsigned long action, void *data)
+{
+	if(data != current) //do_exit() reports the exiting task itself, the delete path works on current
+		return NOTIFY_DONE;
+	return processor_container_delete(NULL) == 0 ? NOTIFY_OK : NOTIFY_DONE;
+}
+
+static struct notifier_block exit_notifier = {
+	.notifier_call = task_exiting,
+};
+static int exits_watched; //exit_notifier is registered
+
+
+/**
+ * Look up what the container timers need and is not exported to modules,
+ * allocate the trace rings, create /proc/pcontainer and ask to be told
+ * about exiting threads. Kernels built without CONFIG_PROFILING cannot
+ * tell us; a member that exits without deleting itself then leaves when
+ * its pending preemption runs on the way out.
+ */
+int processor_container_sched_init(void)
+{
+	do_task_work_add = (task_work_add_t)kallsyms_lookup_name("task_work_add");
+	do_task_work_cancel = (task_work_cancel_t)kallsyms_lookup_name("task_work_cancel");
+	if(do_task_work_add == NULL || do_task_work_cancel == NULL)
+	{
+		printk(KERN_ERR "\"processor_container\" cannot find task_work_add(), containers could not be time sliced\n");
+		return -ENOENT;
+	}
+	if(trace)
+	{
+		int cpu;
+
+		trace_buf = vmalloc_user(nr_cpu_ids * PCONTAINER_TRACE_SEGMENT);
+		if(trace_buf == NULL)
+			return -ENOMEM;
+		for(cpu = 0; cpu < nr_cpu_ids; cpu++)
+		{
+			struct processor_container_trace_ring *ring = trace_buf + cpu * PCONTAINER_TRACE_SEGMENT;
+
+			ring->cpu = cpu;
+			ring->nr_cpus = nr_cpu_ids;
+		}
+	}
+	if(proc_create("pcontainer", S_IRUGO, NULL, &processor_container_proc_fops) == NULL)
+	{
+		vfree(trace_buf);
+		trace_buf = NULL;
+		return -ENOMEM;
+	}
+#ifdef CONFIG_PREEMPT_NOTIFIERS
+	preempt_notifier_inc();
+#endif
+	exits_watched = profile_event_register(PROFILE_TASK_EXIT, &exit_notifier) == 0;
+	if(!exits_watched)
+		printk(KERN_WARNING "\"processor_container\" gets no exit notifications, threads that exit without deleting themselves leave only at their next preemption\n");
+	return 0;
+}
+
+
+/**
+ * Remove /proc/pcontainer, free the trace rings and stop the timers of containers whose threads
+ * exited without deleting themselves.
+ */
+void processor_container_sched_exit(void)
+{
+	container_list *temp;
+
+	if(exits_watched)
+		profile_event_unregister(PROFILE_TASK_EXIT, &exit_notifier);
+	exits_watched = 0;
+	remove_proc_entry("pcontainer", NULL);
+	while(head != NULL)
+	{
+		temp = head;
+		head = head->next;
+		hrtimer_cancel(&temp->timer);
+		kfree(temp);
+	}
+	vfree(trace_buf); //no mapping is left once the device is closed
+	trace_buf = NULL;
+#ifdef CONFIG_PREEMPT_NOTIFIERS
+	preempt_notifier_dec();
+#endif
+}
+
+
 
 
 /**
@@ -316,6 +1441,18 @@ int processor_container_ioctl(struct file *filp, unsigned int cmd,
         return processor_container_create((void __user *)arg);
     case PCONTAINER_IOCTL_DELETE:
         return processor_container_delete((void __user *)arg);
+    case PCONTAINER_IOCTL_QUANTUM:
+        return processor_container_quantum((void __user *)arg);
+    case PCONTAINER_IOCTL_WEIGHT:
+        return processor_container_weight((void __user *)arg);
+    case PCONTAINER_IOCTL_TICKETS:
+        return processor_container_tickets((void __user *)arg);
+    case PCONTAINER_IOCTL_PARALLEL:
+        return processor_container_parallel((void __user *)arg);
+    case PCONTAINER_IOCTL_AFFINITY:
+        return processor_container_affinity((void __user *)arg);
+    case PCONTAINER_IOCTL_STATS:
+        return processor_container_stats((void __user *)arg);
     default:
         return -ENOTTY;
     }
@@ -27,8 +27,93 @@ int pcontainer_delete(int devfd, int id)
  * for creating the current task in specified container.
  */
 int pcontainer_create(int devfd, int id)
+{
+    return pcontainer_create_policy(devfd, id, PCONTAINER_POLICY_RR);
+}
+
+/**
+ * create function in user space that sends command to kernel space
+ * for creating the current task in specified container, scheduling the
+ * container by the given PCONTAINER_POLICY_* if it is new.
+ */
+int pcontainer_create_policy(int devfd, int id, int policy)
 {
     struct processor_container_cmd cmd;
     cmd.cid = id;
+    cmd.op = policy;
     return ioctl(devfd, PCONTAINER_IOCTL_CREATE, &cmd);
 }
+
+/**
+ * quantum function in user space that sends command to kernel space
+ * for setting the time slice of the specified container in microseconds,
+ * 0 for the module default.
+ */
+int pcontainer_quantum(int devfd, int id, unsigned long usec)
+{
+    struct processor_container_cmd cmd;
+    cmd.cid = id;
+    cmd.op = usec;
+    return ioctl(devfd, PCONTAINER_IOCTL_QUANTUM, &cmd);
+}
+
+/**
+ * weight function in user space that sends command to kernel space
+ * for setting the share of the specified container, 0 for the default.
+ */
+int pcontainer_weight(int devfd, int id, unsigned long weight)
+{
+    struct processor_container_cmd cmd;
+    cmd.cid = id;
+    cmd.op = weight;
+    return ioctl(devfd, PCONTAINER_IOCTL_WEIGHT, &cmd);
+}
+
+/**
+ * tickets function in user space that sends command to kernel space
+ * for setting the share of the current task under the stride and lottery
+ * policies, 0 for the default.
+ */
+int pcontainer_tickets(int devfd, unsigned long tickets)
+{
+    struct processor_container_cmd cmd;
+    cmd.cid = 0;
+    cmd.op = tickets;
+    return ioctl(devfd, PCONTAINER_IOCTL_TICKETS, &cmd);
+}
+
+/**
+ * parallel function in user space that sends command to kernel space
+ * for letting up to the given number of tasks of the specified container
+ * run at the same time.
+ */
+int pcontainer_parallel(int devfd, int id, int threads)
+{
+    struct processor_container_cmd cmd;
+    cmd.cid = id;
+    cmd.op = threads;
+    return ioctl(devfd, PCONTAINER_IOCTL_PARALLEL, &cmd);
+}
+
+/**
+ * affinity function in user space that sends command to kernel space
+ * for keeping the tasks of the specified container on the cpus set in
+ * the mask, 0 for all cpus.
+ */
+int pcontainer_affinity(int devfd, int id, unsigned long long cpus)
+{
+    struct processor_container_cmd cmd;
+    cmd.cid = id;
+    cmd.op = cpus;
+    return ioctl(devfd, PCONTAINER_IOCTL_AFFINITY, &cmd);
+}
+
+/**
+ * stats function in user space that sends command to kernel space
+ * for reading the scheduling counters of the specified container.
+ */
+int pcontainer_stats(int devfd, int id, struct processor_container_stats *stats)
+{
+    stats->cid = id;
+    return ioctl(devfd, PCONTAINER_IOCTL_STATS, stats);
+}
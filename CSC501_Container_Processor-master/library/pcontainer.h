@@ -17,41 +17,24 @@ extern "C"
 
     int pcontainer_delete(int devfd, int cid);
     int pcontainer_create(int devfd, int cid);
+    int pcontainer_create_policy(int devfd, int cid, int policy);
+    int pcontainer_tickets(int devfd, unsigned long tickets);
+    int pcontainer_parallel(int devfd, int cid, int threads);
+    int pcontainer_affinity(int devfd, int cid, unsigned long long cpus);
+    int pcontainer_stats(int devfd, int cid, struct processor_container_stats *stats);
     int pcontainer_context_switch_handler(int devfd, int cid);
+    int pcontainer_quantum(int devfd, int cid, unsigned long usec);
+    int pcontainer_weight(int devfd, int cid, unsigned long weight);
     int pcontainer_init(int devfd);
     int DEVFD;
 
     /**
-     * handler function for the timer to run the context switch function.
-     */
-    static void handler()
-    {
-        pcontainer_context_switch_handler(DEVFD, 0);
-    }
-
-    /**
-     * set up the alarm for context switch every time duration.
+     * remember the device. Threads are time sliced by the kernel module, the
+     * context switch function only gives up the rest of a time slice.
      */
     int pcontainer_init(int devfd)
     {
-        struct sigaction sa;
-        struct itimerval timeout;
-
-        sa.sa_flags = SA_SIGINFO | SA_RESTART | SA_ONSTACK;
-        sigemptyset(&sa.sa_mask);
-        sa.sa_sigaction = handler;
-        if (sigaction(SIGPROF, &sa, NULL) == -1)
-        {
-            fprintf(stderr, "sigaction");
-            exit(1);
-        }
-
         DEVFD = devfd;
-        timeout.it_value.tv_sec = 0;
-        timeout.it_value.tv_usec = 5;
-        timeout.it_interval = timeout.it_value;
-        if (setitimer(ITIMER_PROF, &timeout, NULL) == 1)
-            fprintf(stderr, "Timer failed\n");
         return 0;
     }
 